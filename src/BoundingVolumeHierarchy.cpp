@@ -18,6 +18,12 @@ BVH::BVH(const std::vector<tinyobj::real_t>& objVertices, const std::vector<uint
     uint32_t nodeCount = 2 * triangleCount - 1;
     nodes.resize(nodeCount);
 
+    triangleIds.resize(triangleCount);
+    for (uint32_t triangleIndex = 0; triangleIndex < triangleCount; triangleIndex++) 
+    {
+        triangleIds[triangleIndex] = triangleIndex;
+    }
+
     uint32_t nodeIndex = 0;
     constructBVH(0, triangleCount, nodeIndex); 
 }
@@ -62,12 +68,15 @@ void BVH::constructBVH(uint32_t startTriangleIndex, uint32_t endTriangleIndex, u
 
         // Reorder the indices array based on sorted triangle order
         std::vector<uint32_t> tempIndices(currentTriangleCount * 3);
+        std::vector<uint32_t> tempTriangleIds(currentTriangleCount);
         for (uint32_t i = 0; i < currentTriangleCount; i++) 
         {
             uint32_t originalIndex = triangleCentroids[i].first * 3;
             std::copy_n(&indices[originalIndex], 3, &tempIndices[i * 3]);
+            tempTriangleIds[i] = triangleIds[triangleCentroids[i].first];
         }
         std::copy_n(tempIndices.data(), currentTriangleCount * 3, &indices[startTriangleIndex * 3]);
+        std::copy_n(tempTriangleIds.data(), currentTriangleCount, &triangleIds[startTriangleIndex]);
 
         uint32_t mid = (startTriangleIndex + endTriangleIndex) / 2;
 
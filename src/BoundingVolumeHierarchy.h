@@ -20,6 +20,7 @@ public:
     const std::vector<tinyobj::real_t>& getVertices() const { return vertices; }
     const std::vector<uint32_t>& getIndices() const { return indices; }
     const std::vector<BVHNode>& getNodes() const { return nodes; }
+    const std::vector<uint32_t>& getTriangleIds() const { return triangleIds; }
 
     void printBVH(const BVH& bvh);
 
@@ -27,6 +28,7 @@ private:
     const std::vector<tinyobj::real_t>& vertices; // Reference vertex data (x, y, z per vertex)
     std::vector<uint32_t> indices;                // Flat index buffer (v0, v1, v2 per triangle)
     std::vector<BVHNode> nodes;                   // BVH hierarchy
+    std::vector<uint32_t> triangleIds;            // Original triangle index of every reordered triangle (for per-triangle data)
 
     glm::vec3 getVertex(uint32_t index) const;
 
@@ -0,0 +1,189 @@
+#include "EnvironmentMap.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+static const float MATH_PI = 3.14159265358979323846f;
+
+static float luminance(const glm::vec4& color)
+{
+    return color.r * 0.2126f + color.g * 0.7152f + color.b * 0.0722f;
+}
+
+static glm::vec4 decodeRGBE(const uint8_t* rgbe)
+{
+    if (rgbe[3] == 0)
+        return glm::vec4(0.0f);
+
+    float scale = std::ldexp(1.0f, int(rgbe[3]) - (128 + 8));
+    return glm::vec4(rgbe[0] * scale, rgbe[1] * scale, rgbe[2] * scale, 0.0f);
+}
+
+EnvironmentMap::EnvironmentMap(const std::string& filename)
+{
+    if (!loadRadianceHDR(filename)) 
+    {
+        qDebug() << "No environment map loaded from" << filename.c_str() << "- missed rays stay black";
+        width = 0;
+        height = 0;
+        texels.clear();
+    }
+
+    buildDistribution();
+}
+
+bool EnvironmentMap::loadRadianceHDR(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    // Header: text lines up to an empty line, then the resolution string
+    std::string line;
+    std::getline(file, line);
+    if (line.rfind("#?", 0) != 0) 
+    {
+        qDebug() << "Not a Radiance HDR file:" << filename.c_str();
+        return false;
+    }
+
+    while (std::getline(file, line) && !line.empty()) 
+    {
+        if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe") 
+        {
+            qDebug() << "Unsupported HDR format:" << line.c_str();
+            return false;
+        }
+    }
+
+    char ySign, yAxis, xSign, xAxis;
+    int imageHeight = 0;
+    int imageWidth = 0;
+    std::getline(file, line);
+    if (std::sscanf(line.c_str(), "%c%c %d %c%c %d", &ySign, &yAxis, &imageHeight, &xSign, &xAxis, &imageWidth) != 6 ||
+        ySign != '-' || yAxis != 'Y' || xSign != '+' || xAxis != 'X' || imageWidth <= 0 || imageHeight <= 0) 
+    {
+        qDebug() << "Unsupported HDR orientation:" << line.c_str();
+        return false;
+    }
+
+    width = imageWidth;
+    height = imageHeight;
+    texels.resize(size_t(width) * height);
+
+    std::vector<uint8_t> scanline(size_t(width) * 4);
+
+    for (uint32_t y = 0; y < height; ++y) 
+    {
+        uint8_t start[4];
+        if (!file.read(reinterpret_cast<char*>(start), 4))
+            return false;
+
+        bool runLengthEncoded = start[0] == 2 && start[1] == 2 && (start[2] & 0x80) == 0 && 
+                                width >= 8 && width < 32768 && ((uint32_t(start[2]) << 8) | start[3]) == width;
+
+        if (!runLengthEncoded) 
+        {
+            // Flat RGBE pixels, the four bytes already read are the first one
+            std::copy_n(start, 4, scanline.data());
+            if (!file.read(reinterpret_cast<char*>(scanline.data() + 4), std::streamsize(width - 1) * 4))
+                return false;
+        }
+        else 
+        {
+            // Each of the four channels is run-length encoded separately
+            for (uint32_t channel = 0; channel < 4; ++channel) 
+            {
+                uint32_t x = 0;
+                while (x < width) 
+                {
+                    uint8_t count = 0;
+                    if (!file.read(reinterpret_cast<char*>(&count), 1))
+                        return false;
+
+                    if (count > 128) 
+                    {
+                        count -= 128;
+                        uint8_t value = 0;
+                        if (!file.read(reinterpret_cast<char*>(&value), 1) || x + count > width)
+                            return false;
+                        for (uint32_t i = 0; i < count; ++i)
+                            scanline[(x++) * 4 + channel] = value;
+                    }
+                    else 
+                    {
+                        if (count == 0 || x + count > width)
+                            return false;
+                        for (uint32_t i = 0; i < count; ++i) 
+                        {
+                            uint8_t value = 0;
+                            if (!file.read(reinterpret_cast<char*>(&value), 1))
+                                return false;
+                            scanline[(x++) * 4 + channel] = value;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (uint32_t x = 0; x < width; ++x) 
+        {
+            texels[size_t(y) * width + x] = decodeRGBE(&scanline[x * 4]);
+        }
+    }
+
+    qDebug() << "Loaded environment map" << filename.c_str() << width << "x" << height;
+    return true;
+}
+
+void EnvironmentMap::buildDistribution()
+{
+    if (!isLoaded()) 
+    {
+        // Keep the buffers valid for the descriptor set, the shader checks header.width
+        header = EnvironmentHeader{ 0, 0, 0.0f, 0.0f };
+        texels.assign(1, glm::vec4(0.0f));
+        distribution.assign(2, 0.0f);
+        return;
+    }
+
+    // Sampling density is luminance * sin(theta), which undoes the stretching of the equirectangular mapping near the poles
+    distribution.assign((height + 1) + size_t(height) * (width + 1), 0.0f);
+    float* marginalCdf = distribution.data();
+
+    double totalWeight = 0.0;
+
+    for (uint32_t y = 0; y < height; ++y) 
+    {
+        float sinTheta = std::sin(MATH_PI * (y + 0.5f) / height);
+        float* conditionalCdf = distribution.data() + (height + 1) + size_t(y) * (width + 1);
+
+        double rowWeight = 0.0;
+        conditionalCdf[0] = 0.0f;
+        for (uint32_t x = 0; x < width; ++x) 
+        {
+            rowWeight += luminance(texels[size_t(y) * width + x]) * sinTheta;
+            conditionalCdf[x + 1] = float(rowWeight);
+        }
+
+        for (uint32_t x = 1; x <= width; ++x) 
+        {
+            conditionalCdf[x] = rowWeight > 0.0 ? float(conditionalCdf[x] / rowWeight) : float(x) / width;
+        }
+
+        totalWeight += rowWeight;
+        marginalCdf[y + 1] = float(totalWeight);
+    }
+
+    for (uint32_t y = 1; y <= height; ++y) 
+    {
+        marginalCdf[y] = totalWeight > 0.0 ? float(marginalCdf[y] / totalWeight) : float(y) / height;
+    }
+
+    // pdf(u, v) = luminance * sin(theta) * width * height / totalWeight, and pdf(direction) = pdf(u, v) / (2 * PI^2 * sin(theta))
+    float pdfNormalization = totalWeight > 0.0 ? float(double(width) * height / (totalWeight * 2.0 * MATH_PI * MATH_PI)) : 0.0f;
+
+    header = EnvironmentHeader{ width, height, pdfNormalization, 0.0f };
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+struct EnvironmentHeader 
+{
+    uint32_t width;         // 0 when no environment is loaded
+    uint32_t height;
+    float pdfNormalization; // Solid-angle pdf of a direction is luminance(texel) * pdfNormalization
+    float padding;
+};
+
+// Equirectangular HDR environment with a marginal/conditional CDF for importance sampling
+class EnvironmentMap 
+{
+public:
+    EnvironmentMap(const std::string& filename);
+
+    bool isLoaded() const { return width > 0 && height > 0; }
+
+    const std::vector<glm::vec4>& getTexels() const { return texels; }
+    const EnvironmentHeader& getHeader() const { return header; }
+    const std::vector<float>& getDistribution() const { return distribution; }
+
+private:
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    std::vector<glm::vec4> texels;      // RGB radiance per texel, row-major from the top of the image
+    EnvironmentHeader header{};
+    std::vector<float> distribution;    // marginal CDF (height + 1) followed by one conditional CDF (width + 1) per row
+
+    bool loadRadianceHDR(const std::string& filename);
+    void buildDistribution();
+};
\ No newline at end of file
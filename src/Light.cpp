@@ -31,4 +31,119 @@ void Light::packData(const std::vector<glm::vec3>& positions,
 
         lights.push_back(lightData);
     }
+}
+
+static float luminance(const glm::vec3& color)
+{
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+void Light::addEmissiveTriangles(const std::vector<float>& vertices,
+                                 const std::vector<uint32_t>& indices,
+                                 const std::vector<uint32_t>& triangleMaterialIndices,
+                                 const std::vector<MaterialData>& materials)
+{
+    auto getVertex = [&vertices](uint32_t vertexIndex) {
+        return glm::vec3(vertices[vertexIndex * 3], vertices[vertexIndex * 3 + 1], vertices[vertexIndex * 3 + 2]);
+    };
+
+    uint32_t triangleCount = indices.size() / 3;
+    for (uint32_t triangleIndex = 0; triangleIndex < triangleCount; ++triangleIndex) 
+    {
+        glm::vec3 emission = glm::vec3(materials[triangleMaterialIndices[triangleIndex]].emission);
+        if (luminance(emission) <= 0.0f)
+            continue;
+
+        glm::vec3 v0 = getVertex(indices[triangleIndex * 3 + 0]);
+        glm::vec3 v1 = getVertex(indices[triangleIndex * 3 + 1]);
+        glm::vec3 v2 = getVertex(indices[triangleIndex * 3 + 2]);
+        float area = 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
+        if (area <= 0.0f)
+            continue;
+
+        EmissiveTriangleData triangleData;
+        triangleData.v0         = glm::vec4(v0, static_cast<float>(triangleIndex));
+        triangleData.v1         = glm::vec4(v1, 0.0f);
+        triangleData.v2         = glm::vec4(v2, 0.0f);
+        triangleData.emission   = glm::vec4(emission, area);
+
+        emissiveTriangles.push_back(triangleData);
+    }
+}
+
+void Light::buildAliasTable()
+{
+    // Emitter weight is area * luminance, so bright and large emitters get picked more often
+    std::vector<float> weights;
+    weights.reserve(lights.size() + emissiveTriangles.size());
+
+    for (const AreaLightData& light : lights) 
+    {
+        weights.push_back(light.size.x * light.size.y * luminance(glm::vec3(light.intensity)));
+    }
+    for (const EmissiveTriangleData& triangle : emissiveTriangles) 
+    {
+        weights.push_back(triangle.emission.w * luminance(glm::vec3(triangle.emission)));
+    }
+
+    uint32_t emitterCount = weights.size();
+
+    float totalWeight = 0.0f;
+    for (float weight : weights) 
+    {
+        totalWeight += weight;
+    }
+
+    samplerHeader.emitterCount      = emitterCount;
+    samplerHeader.areaLightCount    = lights.size();
+    samplerHeader.totalWeight       = totalWeight;
+
+    aliasTable.assign(emitterCount, AliasTableEntry{ 1.0f, 0, 0.0f, 0.0f });
+    if (emitterCount == 0 || totalWeight <= 0.0f)
+        return;
+
+    // Vose's method: split bins into under- and over-full, then top up every small bin from a large one
+    std::vector<float> scaledWeights(emitterCount);
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+
+    for (uint32_t i = 0; i < emitterCount; ++i) 
+    {
+        aliasTable[i].alias = i;
+        aliasTable[i].pdf   = weights[i] / totalWeight;
+        scaledWeights[i]    = weights[i] / totalWeight * emitterCount;
+
+        if (scaledWeights[i] < 1.0f)
+            small.push_back(i);
+        else
+            large.push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) 
+    {
+        uint32_t smallIndex = small.back();
+        small.pop_back();
+        uint32_t largeIndex = large.back();
+        large.pop_back();
+
+        aliasTable[smallIndex].probability  = scaledWeights[smallIndex];
+        aliasTable[smallIndex].alias        = largeIndex;
+
+        scaledWeights[largeIndex] = (scaledWeights[largeIndex] + scaledWeights[smallIndex]) - 1.0f;
+
+        if (scaledWeights[largeIndex] < 1.0f)
+            small.push_back(largeIndex);
+        else
+            large.push_back(largeIndex);
+    }
+
+    // Leftovers are only off from 1 by rounding error
+    for (uint32_t index : large) 
+    {
+        aliasTable[index].probability = 1.0f;
+    }
+    for (uint32_t index : small) 
+    {
+        aliasTable[index].probability = 1.0f;
+    }
 }
\ No newline at end of file
@@ -11,6 +11,36 @@ struct AreaLightData
     glm::vec4 size;      // xy = width and height
 };
 
+struct EmissiveTriangleData 
+{
+    glm::vec4 v0;       // xyz = vertex, w = triangle index in the BVH ordered index buffer
+    glm::vec4 v1;       // xyz = vertex, w = padding
+    glm::vec4 v2;       // xyz = vertex, w = padding
+    glm::vec4 emission; // xyz = emitted radiance, w = area
+};
+
+struct MaterialData 
+{
+    glm::vec4 diffuse;  // xyz = albedo, w = padding
+    glm::vec4 emission; // xyz = emitted radiance, w = padding
+};
+
+struct AliasTableEntry 
+{
+    float probability; // Chance of keeping this emitter when its bin is picked
+    uint32_t alias;    // Emitter used otherwise
+    float pdf;         // Selection probability of this emitter
+    float padding;
+};
+
+struct LightSamplerHeader 
+{
+    uint32_t emitterCount;   // Area lights first, then emissive triangles
+    uint32_t areaLightCount;
+    float totalWeight;       // Sum of area * luminance over all emitters
+    float padding;
+};
+
 class Light 
 {
 public:
@@ -21,10 +51,24 @@ public:
 
     Light();
 
+    void addEmissiveTriangles(const std::vector<float>& vertices,
+                              const std::vector<uint32_t>& indices,
+                              const std::vector<uint32_t>& triangleMaterialIndices,
+                              const std::vector<MaterialData>& materials);
+
+    void buildAliasTable();
+
     const std::vector<AreaLightData>& getLights() const { return lights; }
+    const std::vector<EmissiveTriangleData>& getEmissiveTriangles() const { return emissiveTriangles; }
+    const LightSamplerHeader& getSamplerHeader() const { return samplerHeader; }
+    const std::vector<AliasTableEntry>& getAliasTable() const { return aliasTable; }
 
 private:
     std::vector<AreaLightData> lights;
+    std::vector<EmissiveTriangleData> emissiveTriangles;
+
+    LightSamplerHeader samplerHeader{};
+    std::vector<AliasTableEntry> aliasTable;
 
     void packData(const std::vector<glm::vec3>& positions,
                   const std::vector<glm::vec3>& normals,
@@ -0,0 +1,76 @@
+#include "PresentationScheduler.h"
+
+#include <QLoggingCategory>
+
+// Off by default, QT_LOGGING_RULES="pathtracer.presentation.debug=true" prints the rates once per second
+Q_LOGGING_CATEGORY(lcPresentation, "pathtracer.presentation", QtWarningMsg)
+
+static const qint64 RATE_WINDOW_NS = 1000000000;
+
+PresentationScheduler::PresentationScheduler()
+{
+    m_clock.start();
+}
+
+void PresentationScheduler::setDisplayRate(double refreshRate)
+{
+    if (refreshRate <= 0.0)
+        return;
+
+    m_publishIntervalNs = qint64(1.0e9 / refreshRate);
+}
+
+void PresentationScheduler::requestPresent()
+{
+    m_presentRequested = true;
+}
+
+void PresentationScheduler::onPresented()
+{
+    m_presentCount++;
+    updateRates();
+}
+
+bool PresentationScheduler::shouldPublish()
+{
+    // A waiting renderer gets the next batch, otherwise publish at display cadence. The ray tracer also holds
+    // publishing back until the renderer has picked up the previous image, which a hidden window never does
+    if (m_presentRequested)
+        return true;
+
+    return m_clock.nsecsElapsed() - m_lastPublishNs >= m_publishIntervalNs;
+}
+
+void PresentationScheduler::onBatchCompleted()
+{
+    m_batchCount++;
+    updateRates();
+}
+
+void PresentationScheduler::onPublished()
+{
+    m_presentRequested = false;
+    m_lastPublishNs = m_clock.nsecsElapsed();
+}
+
+void PresentationScheduler::updateRates()
+{
+    std::lock_guard<std::mutex> lock(m_rateMutex);
+
+    qint64 nowNs = m_clock.nsecsElapsed();
+    qint64 elapsedNs = nowNs - m_rateWindowStartNs;
+    if (elapsedNs < RATE_WINDOW_NS)
+        return;
+
+    uint64_t batchCount = m_batchCount;
+    uint64_t presentCount = m_presentCount;
+
+    m_batchesPerSecond  = double(batchCount - m_rateWindowBatchCount) * 1.0e9 / double(elapsedNs);
+    m_presentsPerSecond = double(presentCount - m_rateWindowPresentCount) * 1.0e9 / double(elapsedNs);
+
+    m_rateWindowStartNs = nowNs;
+    m_rateWindowBatchCount = batchCount;
+    m_rateWindowPresentCount = presentCount;
+
+    qCDebug(lcPresentation, "Accumulation: %.1f batches/s, display: %.1f presents/s", double(m_batchesPerSecond), double(m_presentsPerSecond));
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <atomic>
+#include <mutex>
+
+// Decides when the ray tracer hands a finished accumulation image to the renderer.
+// Batches run freely, an image is published when the renderer asks for one or at display cadence.
+class PresentationScheduler 
+{
+public:
+    PresentationScheduler();
+
+    void setDisplayRate(double refreshRate);
+
+    // Renderer side, called from the GUI thread
+    void requestPresent();
+    void onPresented();
+
+    // Ray tracer side, called from the worker thread
+    bool shouldPublish();
+    void onBatchCompleted();
+    void onPublished();
+
+    double getBatchesPerSecond() const { return m_batchesPerSecond; }
+    double getPresentsPerSecond() const { return m_presentsPerSecond; }
+
+private:
+    void updateRates();
+
+    QElapsedTimer m_clock{};
+
+    std::atomic<qint64> m_publishIntervalNs = 16666667;
+    std::atomic<qint64> m_lastPublishNs = 0;
+    std::atomic<bool> m_presentRequested = true;
+
+    std::atomic<uint64_t> m_batchCount = 0;
+    std::atomic<uint64_t> m_presentCount = 0;
+
+    // Rates are refreshed about once per second
+    std::mutex m_rateMutex{};
+    qint64 m_rateWindowStartNs = 0;
+    uint64_t m_rateWindowBatchCount = 0;
+    uint64_t m_rateWindowPresentCount = 0;
+    std::atomic<double> m_batchesPerSecond = 0.0;
+    std::atomic<double> m_presentsPerSecond = 0.0;
+};
\ No newline at end of file
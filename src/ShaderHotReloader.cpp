@@ -0,0 +1,166 @@
+#include "ShaderHotReloader.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+static const QStringList SHADER_SOURCE_FILTERS = { "*.vert", "*.frag", "*.comp", "*.glsl" };
+
+// Same extra builds as CMakeLists.txt, the source is also compiled with the define into a SPIR-V of the variant's name
+struct ShaderVariant 
+{
+    const char* shaderName;
+    const char* variantName;
+    const char* define;
+};
+
+static const ShaderVariant SHADER_VARIANTS[] = {
+    { "raytrace_comp", "raytrace_stats_comp", "-DCOHERENCE_STATS_SUBGROUPS" }
+};
+
+ShaderHotReloader::ShaderHotReloader(const QString& sourceDirectory, const QString& compilerPath, const QString& targetEnv, ReloadCallback callback)
+    : m_sourceDirectory(sourceDirectory),
+      m_compilerPath(compilerPath),
+      m_targetEnv(targetEnv),
+      m_callback(std::move(callback))
+{
+    m_outputDirectory = QDir::temp().filePath(QStringLiteral("discovering-path-tracer-shaders"));
+    QDir().mkpath(m_outputDirectory);
+
+    m_debounceTimer.setSingleShot(true);
+    m_debounceTimer.setInterval(DEBOUNCE_MS);
+
+    QObject::connect(&m_debounceTimer, &QTimer::timeout, &m_debounceTimer, [this]() { compileNext(); });
+    QObject::connect(&m_process, &QProcess::finished, &m_process, [this](int exitCode, QProcess::ExitStatus exitStatus) { 
+        onCompileFinished(exitCode, exitStatus); 
+    });
+    // finished is never emitted for a compiler that could not be started, the queue would stall on it
+    QObject::connect(&m_process, &QProcess::errorOccurred, &m_process, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart) 
+            return;
+
+        qWarning("Could not start %s to compile shader %s: %s", qPrintable(m_compilerPath), 
+                 qPrintable(m_compiling.shaderName), qPrintable(m_process.errorString()));
+        compileNext();
+    });
+
+    // Saving may replace the file instead of writing to it, which drops it from the watcher.
+    // The directory is watched as well so replaced files are picked up again
+    QObject::connect(&m_watcher, &QFileSystemWatcher::fileChanged, &m_watcher, [this](const QString& path) {
+        if (QFileInfo::exists(path))
+            queueSource(path);
+    });
+    QObject::connect(&m_watcher, &QFileSystemWatcher::directoryChanged, &m_watcher, [this](const QString&) { 
+        watchSources(); 
+    });
+
+    watchSources();
+
+    qDebug("Watching %s for shader changes", qPrintable(m_sourceDirectory));
+}
+
+ShaderHotReloader::~ShaderHotReloader()
+{
+    // No callback may run while the window and ray tracer are being torn down
+    m_process.disconnect();
+    if (m_process.state() != QProcess::NotRunning) 
+    {
+        m_process.kill();
+        m_process.waitForFinished();
+        QFile::remove(m_compilingOutput);
+    }
+
+    for (const QString& output : std::as_const(m_latestOutputs))
+        QFile::remove(output);
+}
+
+void ShaderHotReloader::watchSources()
+{
+    if (!m_watcher.directories().contains(m_sourceDirectory))
+        m_watcher.addPath(m_sourceDirectory);
+
+    const QStringList watchedFiles = m_watcher.files();
+    for (const QFileInfo& fileInfo : QDir(m_sourceDirectory).entryInfoList(SHADER_SOURCE_FILTERS, QDir::Files)) 
+    {
+        QString sourcePath = fileInfo.absoluteFilePath();
+        if (watchedFiles.contains(sourcePath))
+            continue;
+
+        // Newly created or replaced on save. Nothing is compiled on the first pass, the embedded SPIR-V is current
+        bool isInitialScan = watchedFiles.isEmpty();
+        m_watcher.addPath(sourcePath);
+        if (!isInitialScan) 
+            queueSource(sourcePath);
+    }
+}
+
+void ShaderHotReloader::queueSource(const QString& sourcePath)
+{
+    // Shared code has no stage of its own, every stage that may include it is rebuilt
+    if (sourcePath.endsWith(QStringLiteral(".glsl"))) 
+    {
+        for (const QFileInfo& fileInfo : QDir(m_sourceDirectory).entryInfoList(SHADER_SOURCE_FILTERS, QDir::Files)) 
+            if (fileInfo.suffix() != QStringLiteral("glsl"))
+                queueSource(fileInfo.absoluteFilePath());
+        return;
+    }
+
+    QString shaderName = QFileInfo(sourcePath).completeBaseName();
+    queueCompile(sourcePath, shaderName, {});
+
+    for (const ShaderVariant& variant : SHADER_VARIANTS) 
+        if (shaderName == QLatin1String(variant.shaderName))
+            queueCompile(sourcePath, QLatin1String(variant.variantName), { QLatin1String(variant.define) });
+
+    m_debounceTimer.start();
+}
+
+void ShaderHotReloader::queueCompile(const QString& sourcePath, const QString& shaderName, const QStringList& defines)
+{
+    for (const ShaderCompile& queuedCompile : m_queuedCompiles) 
+        if (queuedCompile.shaderName == shaderName)
+            return;
+
+    m_queuedCompiles.append(ShaderCompile{ sourcePath, shaderName, defines });
+}
+
+void ShaderHotReloader::compileNext()
+{
+    if (m_process.state() != QProcess::NotRunning || m_queuedCompiles.isEmpty()) 
+        return;
+
+    m_compiling = m_queuedCompiles.takeFirst();
+    m_compilingOutput = QDir(m_outputDirectory).filePath(
+        QStringLiteral("%1_%2.spv").arg(m_compiling.shaderName).arg(++m_compileCount));
+
+    // Same invocation as the configure step in CMakeLists.txt
+    QStringList arguments = { QStringLiteral("-V"), QStringLiteral("--target-env"), m_targetEnv };
+    arguments << m_compiling.defines << m_compiling.sourcePath << QStringLiteral("-o") << m_compilingOutput;
+
+    m_process.setProcessChannelMode(QProcess::MergedChannels);
+    m_process.start(m_compilerPath, arguments);
+}
+
+void ShaderHotReloader::onCompileFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    const QString& shaderName = m_compiling.shaderName;
+
+    if (exitStatus != QProcess::NormalExit || exitCode != 0) 
+    {
+        // The running pipeline stays in place until the source compiles again
+        qWarning("Shader %s failed to compile:\n%s", qPrintable(shaderName), m_process.readAll().constData());
+        QFile::remove(m_compilingOutput);
+    }
+    else 
+    {
+        qDebug("Recompiled shader %s", qPrintable(shaderName));
+        m_callback(shaderName, m_compilingOutput);
+
+        // The callback has switched the reader over to the new file, the previous one is never read again
+        QString previousOutput = m_latestOutputs.value(shaderName);
+        if (!previousOutput.isEmpty())
+            QFile::remove(previousOutput);
+        m_latestOutputs.insert(shaderName, m_compilingOutput);
+    }
+
+    compileNext();
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QProcess>
+#include <QStringList>
+#include <QTimer>
+#include <functional>
+
+// Development aid, built with -DSHADER_HOT_RELOAD=ON. Watches the GLSL sources and recompiles changed files with
+// glslangValidator in the background, one process at a time. Each successful compile reports the shader name
+// (file name without extension, as in the qrc alias) and a fresh SPIR-V file. Lives on the GUI thread
+class ShaderHotReloader 
+{
+public:
+    using ReloadCallback = std::function<void(const QString& shaderName, const QString& spirvPath)>;
+
+    ShaderHotReloader(const QString& sourceDirectory, const QString& compilerPath, const QString& targetEnv, ReloadCallback callback);
+    ~ShaderHotReloader();
+
+    ShaderHotReloader(const ShaderHotReloader&) = delete;
+    ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+
+private:
+    void watchSources();
+    void queueSource(const QString& sourcePath);
+    void queueCompile(const QString& sourcePath, const QString& shaderName, const QStringList& defines);
+    void compileNext();
+    void onCompileFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+    struct ShaderCompile 
+    {
+        QString sourcePath;
+        QString shaderName;     // Names the SPIR-V, a variant of a source has a name of its own
+        QStringList defines;
+    };
+
+    // Editors often save in several steps, changes are collected until the sources have been quiet this long
+    static constexpr int DEBOUNCE_MS = 150;
+
+    QString m_sourceDirectory{};
+    QString m_compilerPath{};
+    QString m_targetEnv{};          // --target-env of glslangValidator, the subgroup operations need SPIR-V 1.3 or newer
+    QString m_outputDirectory{};
+    ReloadCallback m_callback{};
+
+    QFileSystemWatcher m_watcher{};
+    QTimer m_debounceTimer{};
+    QProcess m_process{};
+
+    QList<ShaderCompile> m_queuedCompiles{};
+    ShaderCompile m_compiling{};
+    QString m_compilingOutput{};
+    uint32_t m_compileCount = 0; // Every output gets a new name, the ray tracer may still be reading the previous one
+
+    // Newest successful output per shader name, handed to the callback. Older and failed outputs are deleted right
+    // away, these on destruction
+    QHash<QString, QString> m_latestOutputs{};
+};
\ No newline at end of file
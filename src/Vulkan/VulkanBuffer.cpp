@@ -28,7 +28,7 @@ void VulkanBuffer::swap(VulkanBuffer& other) noexcept
     
     // Vulkan resources
     std::swap(m_buffer, other.m_buffer);
-    std::swap(m_memory, other.m_memory);
+    std::swap(m_allocation, other.m_allocation);
     
     // Device resources
     std::swap(m_result, other.m_result);
@@ -71,21 +71,15 @@ void VulkanBuffer::allocateMemory()
     VkMemoryRequirements memoryRequirements;
     m_deviceFunctions->vkGetBufferMemoryRequirements(m_vulkanWindow->device(), m_buffer, &memoryRequirements);
 
-    VkMemoryAllocateInfo memoryAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .allocationSize = memoryRequirements.size,
-        .memoryTypeIndex = m_memoryTypeIndex
-    };
-
-    m_result = m_deviceFunctions->vkAllocateMemory(m_vulkanWindow->device(), &memoryAllocateInfo, nullptr, &m_memory);
-    if (m_result != VK_SUCCESS)
+    // Sub-allocated from a shared block, host-visible blocks are mapped by the allocator for their whole lifetime
+    m_allocation = m_vulkanWindow->getMemoryAllocator().allocate(memoryRequirements, m_memoryTypeIndex, false);
+    if (m_allocation.memory == VK_NULL_HANDLE)
     {
-        qWarning("Failed to allocate memory (error code: %d)", m_result);
+        qWarning("Failed to allocate memory for buffer of %llu bytes", static_cast<unsigned long long>(m_size));
         return;
     }
 
-    m_result = m_deviceFunctions->vkBindBufferMemory(m_vulkanWindow->device(), m_buffer, m_memory, 0);
+    m_result = m_deviceFunctions->vkBindBufferMemory(m_vulkanWindow->device(), m_buffer, m_allocation.memory, m_allocation.offset);
     if (m_result != VK_SUCCESS)
     {
         qWarning("Failed to bind buffer memory (error code: %d)", m_result);
@@ -95,50 +89,32 @@ void VulkanBuffer::allocateMemory()
 
 void VulkanBuffer::cleanup()
 {
-    if (m_memory != VK_NULL_HANDLE) 
-    {
-        vkFreeMemory(m_vulkanWindow->device(), m_memory, nullptr);
-        m_memory = VK_NULL_HANDLE;
-    }
+    // The range goes back to the allocator only once nothing is bound to it
     if (m_buffer != VK_NULL_HANDLE) 
     {
         vkDestroyBuffer(m_vulkanWindow->device(), m_buffer, nullptr);
         m_buffer = VK_NULL_HANDLE;
     }
+    if (m_allocation.memory != VK_NULL_HANDLE) 
+    {
+        m_vulkanWindow->getMemoryAllocator().free(m_allocation);
+    }
 }
 
 void VulkanBuffer::copyData(const void* data, VkDeviceSize size, VkDeviceSize offset)
 {
-    VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_vulkanWindow->physicalDevice(), &physicalDeviceMemoryProperties);
-
-    // Ensure the memory type is host-visible
-    if (!(physicalDeviceMemoryProperties.memoryTypes[m_memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+    if (m_allocation.mappedData == nullptr)
     {
-        qWarning("Cannot map memory: Buffer is not host-visible.");
-        return;
-    }
-    
-    void* mappedData = nullptr;
-    m_result = m_deviceFunctions->vkMapMemory(m_vulkanWindow->device(), m_memory, offset, size, 0, &mappedData);
-    if (m_result != VK_SUCCESS)
-    {
-        qWarning("Failed to map memory (error code: %d)", m_result);
+        qWarning("Cannot copy data: Buffer is not host-visible.");
         return;
     }
 
-    memcpy(mappedData, data, static_cast<size_t>(size));
+    memcpy(static_cast<char*>(m_allocation.mappedData) + offset, data, static_cast<size_t>(size));
 
-    // Flush memory if not HOST_COHERENT
-    if (!(physicalDeviceMemoryProperties.memoryTypes[m_memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
-    {
-        VkMappedMemoryRange range{};
-        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        range.memory = m_memory;
-        range.offset = offset;
-        range.size = size;
-        vkFlushMappedMemoryRanges(m_vulkanWindow->device(), 1, &range);
-    }
+    flush(offset, size);
+}
 
-    m_deviceFunctions->vkUnmapMemory(m_vulkanWindow->device(), m_memory);
+void VulkanBuffer::flush(VkDeviceSize offset, VkDeviceSize size)
+{
+    m_vulkanWindow->getMemoryAllocator().flush(m_allocation, offset, size);
 }
\ No newline at end of file
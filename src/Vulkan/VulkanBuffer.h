@@ -3,6 +3,8 @@
 #include <vulkan/vulkan.h>
 #include <QVulkanDeviceFunctions>
 
+#include "VulkanMemoryAllocator.h"
+
 class VulkanWindow;
 
 class VulkanBuffer 
@@ -17,8 +19,13 @@ public:
     VulkanBuffer& operator=(VulkanBuffer&& other) noexcept;
 
     VkBuffer getBuffer() const { return m_buffer; }
+    VkDeviceSize getSize() const { return m_size; }
+
+    // Host-visible buffers stay mapped for their whole lifetime, nullptr for device-local ones
+    void* getMappedData() const { return m_allocation.mappedData; }
     
     void copyData(const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+    void flush(VkDeviceSize offset, VkDeviceSize size);
 
     void destroy() { cleanup(); }
 
@@ -34,7 +41,7 @@ private:
     uint32_t m_memoryTypeIndex{};
 
     VkBuffer m_buffer = VK_NULL_HANDLE;
-    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+    VulkanAllocation m_allocation{};
     
     VkResult m_result = VK_NOT_READY;
     QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
@@ -17,6 +17,33 @@ VulkanCommandBuffer::~VulkanCommandBuffer()
     cleanup();
 }
 
+void VulkanCommandBuffer::swap(VulkanCommandBuffer& other) noexcept
+{
+    std::swap(m_vulkanWindow, other.m_vulkanWindow);
+    std::swap(m_commandPool, other.m_commandPool);
+    std::swap(m_queue, other.m_queue);
+
+    // Vulkan resources
+    std::swap(m_fence, other.m_fence);
+    std::swap(m_commandBuffer, other.m_commandBuffer);
+    std::swap(m_isRecording, other.m_isRecording);
+    std::swap(m_isPending, other.m_isPending);
+
+    // Device resources
+    std::swap(m_result, other.m_result);
+    std::swap(m_deviceFunctions, other.m_deviceFunctions);
+}
+
+VulkanCommandBuffer& VulkanCommandBuffer::operator=(VulkanCommandBuffer&& other) noexcept 
+{
+    if (this != &other) 
+    {
+        cleanup();
+        swap(other);
+    }
+    return *this;
+}
+
 void VulkanCommandBuffer::createCommandBuffer()
 {
     VkCommandBufferAllocateInfo commandBufferAllocateInfo 
@@ -55,6 +82,9 @@ void VulkanCommandBuffer::createFence()
 
 void VulkanCommandBuffer::cleanup()
 {
+    // Freeing a command buffer the GPU still executes is invalid
+    wait();
+
     if (m_commandBuffer != VK_NULL_HANDLE)
     {
         m_deviceFunctions->vkFreeCommandBuffers(m_vulkanWindow->device(), m_commandPool, 1, &m_commandBuffer);
@@ -68,6 +98,19 @@ void VulkanCommandBuffer::cleanup()
 }
 
 void VulkanCommandBuffer::beginSingleTimeCommandBuffer()
+{
+    begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+}
+
+void VulkanCommandBuffer::beginCommandBuffer()
+{
+    // Recording must not start while the previous submission may still execute
+    wait();
+
+    begin(0);
+}
+
+void VulkanCommandBuffer::begin(VkCommandBufferUsageFlags flags)
 {
     if (m_isRecording)
     {
@@ -79,7 +122,7 @@ void VulkanCommandBuffer::beginSingleTimeCommandBuffer()
     {
         .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext            = nullptr,
-        .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .flags            = flags,
         .pInheritanceInfo = nullptr
     };
     
@@ -94,21 +137,34 @@ void VulkanCommandBuffer::beginSingleTimeCommandBuffer()
 }
 
 void VulkanCommandBuffer::endSubmitAndWait()
+{
+    endAndSubmit();
+    wait();
+}
+
+bool VulkanCommandBuffer::end()
 {
     if (!m_isRecording)
     {
         qWarning("Attempted to end a command buffer that is not recording!");
-        return;
+        return false;
     }
 
     m_result = m_deviceFunctions->vkEndCommandBuffer(m_commandBuffer);
     if (m_result != VK_SUCCESS)
     {
         qWarning("Failed to end command buffer (error code: %d)", m_result);
-        return;
+        return false;
     }
 
     m_isRecording = false;
+    return true;
+}
+
+void VulkanCommandBuffer::endAndSubmit()
+{
+    if (!end())
+        return;
 
     VkSubmitInfo submitInfo 
     {
@@ -130,6 +186,7 @@ void VulkanCommandBuffer::endSubmitAndWait()
         return;
     }
 
+    auto sharedQueueLock = m_vulkanWindow->lockSharedQueue();
     m_result = m_deviceFunctions->vkQueueSubmit(m_queue, 1, &submitInfo, m_fence);
     if (m_result != VK_SUCCESS)
     {
@@ -137,10 +194,60 @@ void VulkanCommandBuffer::endSubmitAndWait()
         return;
     }
 
+    m_isPending = true;
+}
+
+void VulkanCommandBuffer::endAndSubmit(const VulkanTimelineSubmit& timelineSubmit)
+{
+    if (!end())
+        return;
+
+    bool waits   = timelineSubmit.waitSemaphore != VK_NULL_HANDLE;
+    bool signals = timelineSubmit.signalSemaphore != VK_NULL_HANDLE;
+
+    VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo
+    {
+        .sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .pNext                     = nullptr,
+        .waitSemaphoreValueCount   = waits ? 1u : 0u,
+        .pWaitSemaphoreValues      = &timelineSubmit.waitValue,
+        .signalSemaphoreValueCount = signals ? 1u : 0u,
+        .pSignalSemaphoreValues    = &timelineSubmit.signalValue
+    };
+
+    VkSubmitInfo submitInfo 
+    {
+        .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext                = &timelineSemaphoreSubmitInfo,
+        .waitSemaphoreCount   = waits ? 1u : 0u,
+        .pWaitSemaphores      = &timelineSubmit.waitSemaphore,
+        .pWaitDstStageMask    = &timelineSubmit.waitStage,
+        .commandBufferCount   = 1,
+        .pCommandBuffers      = &m_commandBuffer,
+        .signalSemaphoreCount = signals ? 1u : 0u,
+        .pSignalSemaphores    = &timelineSubmit.signalSemaphore
+    };   
+
+    auto sharedQueueLock = m_vulkanWindow->lockSharedQueue();
+    m_result = m_deviceFunctions->vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to submit command buffer to queue (error code: %d)", m_result);
+        return;
+    }
+}
+
+void VulkanCommandBuffer::wait()
+{
+    if (!m_isPending)
+        return;
+
     m_result = m_deviceFunctions->vkWaitForFences(m_vulkanWindow->device(), 1, &m_fence, VK_TRUE, UINT64_MAX);
     if (m_result != VK_SUCCESS)
     {
         qWarning("Failed to wait for fence (error code: %d)", m_result);
         return;
     }
+
+    m_isPending = false;
 }
\ No newline at end of file
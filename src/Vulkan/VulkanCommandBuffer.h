@@ -5,6 +5,16 @@
 
 class VulkanWindow;
 
+// Timeline values a submission waits for and signals, unused semaphores stay VK_NULL_HANDLE
+struct VulkanTimelineSubmit
+{
+    VkSemaphore waitSemaphore   = VK_NULL_HANDLE;
+    uint64_t waitValue          = 0;
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSemaphore signalSemaphore = VK_NULL_HANDLE;
+    uint64_t signalValue        = 0;
+};
+
 class VulkanCommandBuffer
 {
 public:
@@ -12,9 +22,19 @@ public:
     VulkanCommandBuffer(VulkanWindow* vulkanWindow, VkCommandPool commandPool, VkQueue queue);
     ~VulkanCommandBuffer();
 
+    VulkanCommandBuffer& operator=(VulkanCommandBuffer&& other) noexcept;
+
     void beginSingleTimeCommandBuffer();
     void endSubmitAndWait();
 
+    // Reusable recording, the pool has to be created with VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+    void beginCommandBuffer();
+    void endAndSubmit();
+    void endAndSubmit(const VulkanTimelineSubmit& timelineSubmit); // No fence, completion is tracked by the signaled value
+    void wait();
+
+    bool isPending() const { return m_isPending; }
+
     VkCommandBuffer getCommandBuffer() const { return m_commandBuffer; }
 
     VkFence getFence() const { return m_fence; }
@@ -25,6 +45,9 @@ private:
     void createCommandBuffer();
     void createFence();
     void cleanup();
+    void swap(VulkanCommandBuffer& other) noexcept;
+    void begin(VkCommandBufferUsageFlags flags);
+    bool end();
 
     VulkanWindow* m_vulkanWindow = nullptr;
     VkCommandPool m_commandPool = VK_NULL_HANDLE;
@@ -33,6 +56,7 @@ private:
 
     VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
     bool m_isRecording = false;
+    bool m_isPending = false;   // Submitted and not waited on yet
 
     VkResult m_result = VK_NOT_READY;
     QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
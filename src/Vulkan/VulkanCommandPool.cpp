@@ -2,9 +2,10 @@
 #include "VulkanWindow.h"
 #include <QVulkanFunctions>
 
-VulkanCommandPool::VulkanCommandPool(VulkanWindow* vulkanWindow, uint32_t queueFamilyIndex)
+VulkanCommandPool::VulkanCommandPool(VulkanWindow* vulkanWindow, uint32_t queueFamilyIndex, VkCommandPoolCreateFlags flags)
     : m_vulkanWindow(vulkanWindow), 
-      m_queueFamilyIndex(queueFamilyIndex)
+      m_queueFamilyIndex(queueFamilyIndex),
+      m_flags(flags)
 {
     m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_vulkanWindow->device());
 
@@ -20,6 +21,7 @@ void VulkanCommandPool::swap(VulkanCommandPool& other) noexcept
 {
     std::swap(m_vulkanWindow, other.m_vulkanWindow);
     std::swap(m_queueFamilyIndex, other.m_queueFamilyIndex);
+    std::swap(m_flags, other.m_flags);
     
     // Vulkan resources
     std::swap(m_commandPool, other.m_commandPool);
@@ -45,7 +47,7 @@ void VulkanCommandPool::createCommandPool()
     {
         .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .pNext            = nullptr,
-        .flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .flags            = m_flags,
         .queueFamilyIndex = m_queueFamilyIndex
     };
 
@@ -9,7 +9,7 @@ class VulkanCommandPool
 {
 public:
     VulkanCommandPool() = default;
-    VulkanCommandPool(VulkanWindow* vulkanWindow, uint32_t queueFamilyIndex);
+    VulkanCommandPool(VulkanWindow* vulkanWindow, uint32_t queueFamilyIndex, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
     ~VulkanCommandPool();
 
     VulkanCommandPool& operator=(VulkanCommandPool&& other) noexcept;
@@ -24,6 +24,7 @@ private:
 
     VulkanWindow* m_vulkanWindow = nullptr;
     uint32_t m_queueFamilyIndex{};
+    VkCommandPoolCreateFlags m_flags{};
 
     VkCommandPool m_commandPool = VK_NULL_HANDLE;
     
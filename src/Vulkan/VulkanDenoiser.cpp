@@ -0,0 +1,407 @@
+#include "VulkanDenoiser.h"
+#include "VulkanWindow.h"
+#include <algorithm>
+#include <cmath>
+
+// PushConstants in denoise_comp.comp
+struct DenoisePushConstants
+{
+    uint32_t input_image;
+    uint32_t output_image;
+    uint32_t feature_image;
+    int32_t step_width;
+    float color_phi;
+    float normal_phi;
+    float depth_phi;
+    float albedo_phi;
+};
+
+static const uint32_t DENOISE_WORKGROUP_SIZE = 16; // local_size in denoise_comp.comp
+
+// images[] in denoise_comp.comp: inputs, outputs, then the scratch image
+static const uint32_t SCRATCH_IMAGE = 2 * VulkanDenoiser::IMAGE_COUNT;
+static const uint32_t DENOISE_IMAGE_COUNT = SCRATCH_IMAGE + 1;
+
+VulkanDenoiser::VulkanDenoiser(VulkanWindow* vulkanWindow, VkPipelineCache pipelineCache)
+    : m_vulkanWindow(vulkanWindow),
+      m_pipelineCache(pipelineCache)
+{
+    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_vulkanWindow->device());
+
+    createDescriptorSet();
+    createPipeline();
+}
+
+VulkanDenoiser::~VulkanDenoiser()
+{
+    cleanup();
+}
+
+void VulkanDenoiser::swap(VulkanDenoiser& other) noexcept
+{
+    std::swap(m_vulkanWindow, other.m_vulkanWindow);
+    std::swap(m_pipelineCache, other.m_pipelineCache);
+    std::swap(m_extent, other.m_extent);
+
+    // VulkanImage is move-assignable only
+    VulkanImage scratchImage{};
+    scratchImage = std::move(other.m_scratchImage);
+    other.m_scratchImage = std::move(m_scratchImage);
+    m_scratchImage = std::move(scratchImage);
+
+    // Vulkan resources
+    std::swap(m_descriptorPool, other.m_descriptorPool);
+    std::swap(m_descriptorSetLayout, other.m_descriptorSetLayout);
+    std::swap(m_descriptorSet, other.m_descriptorSet);
+    std::swap(m_pipelineLayout, other.m_pipelineLayout);
+    std::swap(m_pipeline, other.m_pipeline);
+
+    // Device resources
+    std::swap(m_result, other.m_result);
+    std::swap(m_deviceFunctions, other.m_deviceFunctions);
+}
+
+VulkanDenoiser& VulkanDenoiser::operator=(VulkanDenoiser&& other) noexcept
+{
+    if (this != &other)
+    {
+        cleanup();
+        swap(other);
+    }
+    return *this;
+}
+
+void VulkanDenoiser::createDescriptorSet()
+{
+    VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[] =
+    {
+        {   // Binding 0: Input, output and scratch images
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = DENOISE_IMAGE_COUNT,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 1: Surface Feature Buffer (SSBO)
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+    };
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .bindingCount = sizeof(descriptorSetLayoutBinding) / sizeof(VkDescriptorSetLayoutBinding),
+        .pBindings = descriptorSetLayoutBinding
+    };
+
+    m_result = m_deviceFunctions->vkCreateDescriptorSetLayout(m_vulkanWindow->device(), &descriptorSetLayoutCreateInfo, nullptr, &m_descriptorSetLayout);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create denoiser descriptor set layout (error code: %d)", m_result);
+        return;
+    }
+
+    VkDescriptorPoolSize descriptorPoolSizes[]
+    {
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = DENOISE_IMAGE_COUNT
+        },
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1
+        }
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .maxSets = 1,
+        .poolSizeCount = sizeof(descriptorPoolSizes) / sizeof(VkDescriptorPoolSize),
+        .pPoolSizes = descriptorPoolSizes
+    };
+
+    m_result = m_deviceFunctions->vkCreateDescriptorPool(m_vulkanWindow->device(), &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create denoiser descriptor pool (error code: %d)", m_result);
+        return;
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = m_descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &m_descriptorSetLayout
+    };
+
+    m_result = m_deviceFunctions->vkAllocateDescriptorSets(m_vulkanWindow->device(), &descriptorSetAllocateInfo, &m_descriptorSet);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to allocate denoiser descriptor set (error code: %d)", m_result);
+        return;
+    }
+}
+
+void VulkanDenoiser::createPipeline()
+{
+    if (m_descriptorSetLayout == VK_NULL_HANDLE)
+        return;
+
+    VkPushConstantRange pushConstantRange
+    {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset     = 0,
+        .size       = sizeof(DenoisePushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo
+    {
+        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext                  = nullptr,
+        .flags                  = 0,
+        .setLayoutCount         = 1,
+        .pSetLayouts            = &m_descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &pushConstantRange
+    };
+
+    m_result = m_deviceFunctions->vkCreatePipelineLayout(m_vulkanWindow->device(), &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create denoiser pipeline layout (error code: %d)", m_result);
+        return;
+    }
+
+    VkShaderModule shaderModule = m_vulkanWindow->createShaderModule(QStringLiteral(":/denoise_comp.spv"));
+    if (shaderModule == VK_NULL_HANDLE)
+        return;
+
+    VkComputePipelineCreateInfo computePipelineCreateInfo
+    {
+        .sType              = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext              = nullptr,
+        .flags              = 0,
+        .stage              = {
+            .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext               = nullptr,
+            .flags               = 0,
+            .stage               = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module              = shaderModule,
+            .pName               = "main",
+            .pSpecializationInfo = nullptr
+        },
+        .layout             = m_pipelineLayout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex  = -1
+    };
+
+    m_result = m_deviceFunctions->vkCreateComputePipelines(m_vulkanWindow->device(), m_pipelineCache, 1, &computePipelineCreateInfo, nullptr, &m_pipeline);
+    m_deviceFunctions->vkDestroyShaderModule(m_vulkanWindow->device(), shaderModule, nullptr);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create denoiser pipeline (error code: %d)", m_result);
+        m_pipeline = VK_NULL_HANDLE;
+        return;
+    }
+}
+
+bool VulkanDenoiser::setTargets(VkExtent2D extent,
+                                const std::array<VkImageView, IMAGE_COUNT>& inputViews,
+                                const std::array<VkImageView, IMAGE_COUNT>& outputViews,
+                                VkBuffer featureBuffer, VkDeviceSize featureSize)
+{
+    if (m_pipeline == VK_NULL_HANDLE)
+        return false;
+
+    m_extent        = extent;
+    m_scratchImage  = VulkanImage(m_vulkanWindow,
+                                  extent.width, extent.height,
+                                  VK_IMAGE_USAGE_STORAGE_BIT,
+                                  m_vulkanWindow->deviceLocalMemoryIndex());
+    if (m_scratchImage.getImageView() == VK_NULL_HANDLE)
+        return false;
+
+    VkDescriptorImageInfo descriptorImageInfo[DENOISE_IMAGE_COUNT];
+    for (uint32_t i = 0; i < DENOISE_IMAGE_COUNT; ++i)
+    {
+        VkImageView imageView = m_scratchImage.getImageView();
+        if (i < IMAGE_COUNT)
+            imageView = inputViews[i];
+        else if (i < SCRATCH_IMAGE)
+            imageView = outputViews[i - IMAGE_COUNT];
+
+        descriptorImageInfo[i] = {
+            .sampler = VK_NULL_HANDLE,
+            .imageView = imageView,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+    }
+
+    VkDescriptorBufferInfo featureBufferInfo = {
+        .buffer = featureBuffer,
+        .offset = 0,
+        .range = featureSize
+    };
+
+    VkWriteDescriptorSet descriptorWrites[]
+    {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = m_descriptorSet,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = DENOISE_IMAGE_COUNT,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .pImageInfo = descriptorImageInfo,
+            .pBufferInfo = nullptr,
+            .pTexelBufferView = nullptr
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = m_descriptorSet,
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = nullptr,
+            .pBufferInfo = &featureBufferInfo,
+            .pTexelBufferView = nullptr
+        }
+    };
+
+    m_deviceFunctions->vkUpdateDescriptorSets(m_vulkanWindow->device(), sizeof(descriptorWrites) / sizeof(VkWriteDescriptorSet), descriptorWrites, 0, nullptr);
+
+    return true;
+}
+
+void VulkanDenoiser::record(VkCommandBuffer commandBuffer, uint32_t imageIndex, const DenoiserSettings& settings)
+{
+    if (!isReady())
+        return;
+
+    // Every pass writes all of its output before the next one reads it, so the scratch contents can be discarded
+    VkImageMemoryBarrier scratchBarrier
+    {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = m_scratchImage.getImage(),
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+
+    m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0,
+    0, nullptr,
+    0, nullptr,
+    1, &scratchBarrier);
+
+    m_deviceFunctions->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    m_deviceFunctions->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+    VkMemoryBarrier passMemoryBarrier
+    {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+
+    // The first pass reads the accumulation image, after that passes alternate so that the last one writes the output
+    int32_t iterations      = std::max(settings.iterations, 1);
+    uint32_t outputImage    = IMAGE_COUNT + imageIndex;
+    uint32_t inputImage     = imageIndex;
+
+    for (int32_t pass = 0; pass < iterations; ++pass)
+    {
+        if (pass > 0)
+            m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1, &passMemoryBarrier,
+            0, nullptr,
+            0, nullptr);
+
+        uint32_t passOutput = (iterations - 1 - pass) % 2 == 0 ? outputImage : SCRATCH_IMAGE;
+
+        // Colour edges tighten as the footprint grows, the filtered input is already smoother
+        DenoisePushConstants pushConstants
+        {
+            .input_image    = inputImage,
+            .output_image   = passOutput,
+            .feature_image  = imageIndex,
+            .step_width     = 1 << pass,
+            .color_phi      = settings.colorPhi * std::ldexp(1.0f, -pass),
+            .normal_phi     = settings.normalPhi,
+            .depth_phi      = settings.depthPhi,
+            .albedo_phi     = settings.albedoPhi
+        };
+
+        m_deviceFunctions->vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoisePushConstants), &pushConstants);
+        m_deviceFunctions->vkCmdDispatch(commandBuffer,
+                    (m_extent.width + DENOISE_WORKGROUP_SIZE - 1) / DENOISE_WORKGROUP_SIZE,
+                    (m_extent.height + DENOISE_WORKGROUP_SIZE - 1) / DENOISE_WORKGROUP_SIZE, 1);
+
+        inputImage = passOutput;
+    }
+}
+
+void VulkanDenoiser::cleanup()
+{
+    if (!m_deviceFunctions)
+        return;
+
+    VkDevice device = m_vulkanWindow->device();
+
+    m_scratchImage.destroy();
+
+    if (m_pipeline)
+    {
+        m_deviceFunctions->vkDestroyPipeline(device, m_pipeline, nullptr);
+        m_pipeline = VK_NULL_HANDLE;
+    }
+
+    if (m_pipelineLayout)
+    {
+        m_deviceFunctions->vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+        m_pipelineLayout = VK_NULL_HANDLE;
+    }
+
+    if (m_descriptorPool)
+    {
+        m_deviceFunctions->vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+        m_descriptorPool = VK_NULL_HANDLE;
+        m_descriptorSet = VK_NULL_HANDLE;
+    }
+
+    if (m_descriptorSetLayout)
+    {
+        m_deviceFunctions->vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, nullptr);
+        m_descriptorSetLayout = VK_NULL_HANDLE;
+    }
+}
\ No newline at end of file
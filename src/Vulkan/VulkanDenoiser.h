@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <QVulkanDeviceFunctions>
+#include <array>
+
+#include "VulkanImage.h"
+
+class VulkanWindow;
+
+// Edge-avoiding à-trous filter, see denoise_comp.comp. Changing these never restarts accumulation
+struct DenoiserSettings
+{
+    bool enabled        = false;
+    int32_t iterations  = 5;     // Filter passes, the distance between kernel taps doubles with each one
+    float colorPhi      = 4.0f;  // Squared colour difference tolerated at one sample per pixel, divided by the sample count
+    float normalPhi     = 0.1f;
+    float depthPhi      = 0.1f;  // Relative to the camera hit distance
+    float albedoPhi     = 0.05f;
+
+    bool operator==(const DenoiserSettings&) const = default;
+};
+
+// Filters an accumulation image into a display image on the compute queue. Guided by the camera hit features that
+// raytrace_comp.comp averages for every accumulation image, the accumulation images themselves are only read
+class VulkanDenoiser
+{
+public:
+    static constexpr uint32_t IMAGE_COUNT = 4; // ACCUMULATION_IMAGE_COUNT in VulkanRayTracer.h
+
+    VulkanDenoiser() = default;
+    VulkanDenoiser(VulkanWindow* vulkanWindow, VkPipelineCache pipelineCache);
+    ~VulkanDenoiser();
+
+    VulkanDenoiser(const VulkanDenoiser&) = delete;
+    VulkanDenoiser& operator=(const VulkanDenoiser&) = delete;
+    VulkanDenoiser& operator=(VulkanDenoiser&& other) noexcept;
+
+    // Only valid while no submit that uses the previous targets is pending. Output images must be in GENERAL
+    bool setTargets(VkExtent2D extent,
+                    const std::array<VkImageView, IMAGE_COUNT>& inputViews,
+                    const std::array<VkImageView, IMAGE_COUNT>& outputViews,
+                    VkBuffer featureBuffer, VkDeviceSize featureSize);
+
+    // Drops the scratch image, before the images passed to setTargets() are destroyed
+    void releaseTargets() { m_scratchImage.destroy(); }
+    bool isReady() const { return m_pipeline != VK_NULL_HANDLE && m_scratchImage.getImage() != VK_NULL_HANDLE; }
+
+    // Compute writes to the input must already be visible. The output is left written by compute, the caller makes it
+    // visible to whoever reads it next
+    void record(VkCommandBuffer commandBuffer, uint32_t imageIndex, const DenoiserSettings& settings);
+
+    void destroy() { cleanup(); }
+
+private:
+    void createDescriptorSet();
+    void createPipeline();
+    void cleanup();
+    void swap(VulkanDenoiser& other) noexcept;
+
+    VulkanWindow* m_vulkanWindow = nullptr;
+    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+
+    VkExtent2D m_extent{};
+    VulkanImage m_scratchImage{}; // Passes ping-pong between it and the output image
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+    VkResult m_result = VK_NOT_READY;
+    QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
+};
\ No newline at end of file
@@ -1,12 +1,14 @@
 #include "VulkanImage.h"
 #include "VulkanWindow.h"
 
-VulkanImage::VulkanImage(VulkanWindow* vulkanWindow, uint32_t width, uint32_t height, VkBufferUsageFlags usage, uint32_t memoryTypeIndex)
+VulkanImage::VulkanImage(VulkanWindow* vulkanWindow, uint32_t width, uint32_t height, VkBufferUsageFlags usage, uint32_t memoryTypeIndex,
+                         const std::vector<uint32_t>& queueFamilyIndices)
     : m_vulkanWindow(vulkanWindow), 
       m_width(width), 
       m_height(height), 
       m_usage(usage), 
-      m_memoryTypeIndex(memoryTypeIndex)
+      m_memoryTypeIndex(memoryTypeIndex),
+      m_queueFamilyIndices(queueFamilyIndices)
 {
     m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_vulkanWindow->device());
 
@@ -23,10 +25,11 @@ void VulkanImage::swap(VulkanImage& other) noexcept
     std::swap(m_height, other.m_height);
     std::swap(m_usage, other.m_usage);
     std::swap(m_memoryTypeIndex, other.m_memoryTypeIndex);
+    std::swap(m_queueFamilyIndices, other.m_queueFamilyIndices);
     
     // Vulkan resources
     std::swap(m_image, other.m_image);
-    std::swap(m_memory, other.m_memory);
+    std::swap(m_allocation, other.m_allocation);
     std::swap(m_imageView, other.m_imageView);
     std::swap(m_sampler, other.m_sampler);
     
@@ -65,9 +68,9 @@ void VulkanImage::createImage()
         .samples       = VK_SAMPLE_COUNT_1_BIT,
         .tiling        = VK_IMAGE_TILING_OPTIMAL,
         .usage         = m_usage,
-        .sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 0,
-        .pQueueFamilyIndices   = nullptr,
+        .sharingMode   = m_queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = m_queueFamilyIndices.size() > 1 ? uint32_t(m_queueFamilyIndices.size()) : 0,
+        .pQueueFamilyIndices   = m_queueFamilyIndices.size() > 1 ? m_queueFamilyIndices.data() : nullptr,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
     };
 
@@ -84,22 +87,20 @@ void VulkanImage::allocateMemory()
     VkMemoryRequirements memoryRequirements;
     m_deviceFunctions->vkGetImageMemoryRequirements(m_vulkanWindow->device(), m_image, &memoryRequirements);
     
-    VkMemoryAllocateInfo memoryAllocateInfo
+    // Optimal-tiling images are kept in blocks apart from buffers, see VulkanMemoryAllocator
+    m_allocation = m_vulkanWindow->getMemoryAllocator().allocate(memoryRequirements, m_memoryTypeIndex, true);
+    if (m_allocation.memory == VK_NULL_HANDLE)
     {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .allocationSize = memoryRequirements.size,
-        .memoryTypeIndex = m_memoryTypeIndex
-    };
+        qWarning("Failed to allocate image memory (%ux%u)", m_width, m_height);
+        return;
+    }
 
-    m_result = m_deviceFunctions->vkAllocateMemory(m_vulkanWindow->device(), &memoryAllocateInfo, nullptr, &m_memory);
+    m_result = m_deviceFunctions->vkBindImageMemory(m_vulkanWindow->device(), m_image, m_allocation.memory, m_allocation.offset);
     if (m_result != VK_SUCCESS)
     {
-        qWarning("Failed to allocate image memory (error code: %d)", m_result);
+        qWarning("Failed to bind image memory (error code: %d)", m_result);
         return;
     }
-
-    m_deviceFunctions->vkBindImageMemory(m_vulkanWindow->device(), m_image, m_memory, 0);
 }
 
 void VulkanImage::createImageView()
@@ -174,14 +175,13 @@ void VulkanImage::cleanup()
         m_deviceFunctions->vkDestroyImageView(m_vulkanWindow->device(), m_imageView, nullptr);
         m_imageView = VK_NULL_HANDLE;
     }
-    if (m_memory != VK_NULL_HANDLE) 
-    {
-        m_deviceFunctions->vkFreeMemory(m_vulkanWindow->device(), m_memory, nullptr);
-        m_memory = VK_NULL_HANDLE;
-    }
     if (m_image != VK_NULL_HANDLE) 
     {
         m_deviceFunctions->vkDestroyImage(m_vulkanWindow->device(), m_image, nullptr);
         m_image = VK_NULL_HANDLE;
     }
+    if (m_allocation.memory != VK_NULL_HANDLE) 
+    {
+        m_vulkanWindow->getMemoryAllocator().free(m_allocation);
+    }
 }
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include <vulkan/vulkan.h>
 #include <QVulkanDeviceFunctions>
+#include <vector>
+
+#include "VulkanMemoryAllocator.h"
 
 class VulkanWindow;
 
@@ -9,7 +12,9 @@ class VulkanImage
 {
 public:
     VulkanImage() = default;
-    VulkanImage(VulkanWindow* vulkanWindow, uint32_t width, uint32_t height, VkBufferUsageFlags usage, uint32_t memoryTypeIndex);
+    // More than one queue family makes the image concurrently shared between them
+    VulkanImage(VulkanWindow* vulkanWindow, uint32_t width, uint32_t height, VkBufferUsageFlags usage, uint32_t memoryTypeIndex,
+                const std::vector<uint32_t>& queueFamilyIndices = {});
     ~VulkanImage();
 
     VulkanImage(const VulkanImage&) = delete;
@@ -35,9 +40,10 @@ private:
     uint32_t m_height{};
     VkImageUsageFlags m_usage{};
     uint32_t m_memoryTypeIndex{};
+    std::vector<uint32_t> m_queueFamilyIndices{};
 
     VkImage m_image = VK_NULL_HANDLE;
-    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+    VulkanAllocation m_allocation{};
     VkImageView m_imageView = VK_NULL_HANDLE;
     VkSampler m_sampler = VK_NULL_HANDLE;
     
@@ -0,0 +1,298 @@
+#include "VulkanMemoryAllocator.h"
+#include "VulkanWindow.h"
+#include <QVulkanFunctions>
+#include <algorithm>
+
+struct VulkanMemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+    bool isImage = false;
+    void* mappedData = nullptr;
+
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges{}; // Offset to size, adjacent ranges are always merged
+    uint32_t allocationCount = 0;
+};
+
+VulkanMemoryAllocator::VulkanMemoryAllocator(VulkanWindow* vulkanWindow)
+    : m_vulkanWindow(vulkanWindow)
+{
+}
+
+VulkanMemoryAllocator::~VulkanMemoryAllocator()
+{
+    destroy();
+}
+
+void VulkanMemoryAllocator::initialize()
+{
+    // The device is created after the window, and recreated when it is lost
+    if (m_device == m_vulkanWindow->device())
+        return;
+
+    size_t usedBlockCount = std::count_if(m_blocks.begin(), m_blocks.end(), 
+                                          [](const std::unique_ptr<VulkanMemoryBlock>& b) { return b->allocationCount > 0; });
+    if (usedBlockCount > 0)
+        qWarning("Device changed with %zu memory blocks still allocated", usedBlockCount);
+
+    m_device = m_vulkanWindow->device();
+    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_device);
+    m_vulkanWindow->vulkanInstance()->functions()->vkGetPhysicalDeviceMemoryProperties(m_vulkanWindow->physicalDevice(), &m_memoryProperties);
+    m_blocks.clear();
+}
+
+VulkanMemoryBlock* VulkanMemoryAllocator::createBlock(uint32_t memoryTypeIndex, bool isImage, VkDeviceSize size)
+{
+    VkMemoryAllocateInfo memoryAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    m_result = m_deviceFunctions->vkAllocateMemory(m_device, &memoryAllocateInfo, nullptr, &memory);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to allocate memory block of %llu bytes (error code: %d)", static_cast<unsigned long long>(size), m_result);
+        return nullptr;
+    }
+
+    auto block = std::make_unique<VulkanMemoryBlock>();
+    block->memory           = memory;
+    block->size             = size;
+    block->memoryTypeIndex  = memoryTypeIndex;
+    block->isImage          = isImage;
+    block->freeRanges[0]    = size;
+
+    // Mapped once for the block's lifetime, vkMapMemory can not be called again while any range of it is mapped
+    if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        m_result = m_deviceFunctions->vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &block->mappedData);
+        if (m_result != VK_SUCCESS)
+        {
+            qWarning("Failed to map memory block (error code: %d)", m_result);
+            block->mappedData = nullptr;
+        }
+    }
+
+    m_blocks.push_back(std::move(block));
+    return m_blocks.back().get();
+}
+
+void VulkanMemoryAllocator::destroyBlock(VulkanMemoryBlock* block)
+{
+    if (block->mappedData != nullptr)
+        m_deviceFunctions->vkUnmapMemory(m_device, block->memory);
+
+    m_deviceFunctions->vkFreeMemory(m_device, block->memory, nullptr);
+
+    m_blocks.erase(std::find_if(m_blocks.begin(), m_blocks.end(), 
+                                [block](const std::unique_ptr<VulkanMemoryBlock>& b) { return b.get() == block; }));
+}
+
+VulkanAllocation VulkanMemoryAllocator::allocate(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool isImage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    initialize();
+
+    const VkDeviceSize alignment = std::max<VkDeviceSize>(memoryRequirements.alignment, 1);
+    const VkDeviceSize size = memoryRequirements.size;
+
+    // Best fit over every block of this type and kind, the smallest range that still fits keeps large ones intact
+    VulkanMemoryBlock* bestBlock = nullptr;
+    VkDeviceSize bestRangeOffset = 0;
+    VkDeviceSize bestRangeSize = ~VkDeviceSize(0);
+
+    for (const std::unique_ptr<VulkanMemoryBlock>& block : m_blocks)
+    {
+        if (block->memoryTypeIndex != memoryTypeIndex || block->isImage != isImage)
+            continue;
+
+        for (const auto& [rangeOffset, rangeSize] : block->freeRanges)
+        {
+            VkDeviceSize alignedOffset = (rangeOffset + alignment - 1) / alignment * alignment;
+            if (alignedOffset + size > rangeOffset + rangeSize || rangeSize >= bestRangeSize)
+                continue;
+
+            bestBlock       = block.get();
+            bestRangeOffset = rangeOffset;
+            bestRangeSize   = rangeSize;
+        }
+    }
+
+    if (bestBlock == nullptr)
+    {
+        // Large resources get a block of their own instead of starving the shared ones, small heaps get smaller blocks
+        const VkMemoryHeap& heap = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+        VkDeviceSize blockSize = std::min(DEFAULT_BLOCK_SIZE, heap.size / 8);
+        if (size > blockSize / 2)
+            blockSize = size;
+
+        uint32_t maxAllocations = m_vulkanWindow->physicalDeviceProperties()->limits.maxMemoryAllocationCount;
+        if (m_blocks.size() >= maxAllocations)
+        {
+            qWarning("Memory block count reached maxMemoryAllocationCount (%u)", maxAllocations);
+            return {};
+        }
+
+        bestBlock = createBlock(memoryTypeIndex, isImage, blockSize);
+        if (bestBlock == nullptr)
+            return {};
+
+        bestRangeOffset = 0;
+        bestRangeSize   = blockSize;
+    }
+
+    // Split the range, padding in front of the aligned offset and whatever is left behind stay free
+    VkDeviceSize alignedOffset = (bestRangeOffset + alignment - 1) / alignment * alignment;
+    bestBlock->freeRanges.erase(bestRangeOffset);
+
+    if (alignedOffset > bestRangeOffset)
+        bestBlock->freeRanges[bestRangeOffset] = alignedOffset - bestRangeOffset;
+
+    VkDeviceSize rangeEnd = bestRangeOffset + bestRangeSize;
+    if (alignedOffset + size < rangeEnd)
+        bestBlock->freeRanges[alignedOffset + size] = rangeEnd - (alignedOffset + size);
+
+    bestBlock->allocationCount++;
+
+    return {
+        .memory         = bestBlock->memory,
+        .offset         = alignedOffset,
+        .size           = size,
+        .propertyFlags  = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags,
+        .mappedData     = bestBlock->mappedData ? static_cast<char*>(bestBlock->mappedData) + alignedOffset : nullptr,
+        .block          = bestBlock
+    };
+}
+
+void VulkanMemoryAllocator::free(VulkanAllocation& allocation)
+{
+    if (allocation.block == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Allocations made on a device that was lost and recreated since, their blocks are gone with it
+    bool isLive = std::any_of(m_blocks.begin(), m_blocks.end(), 
+                              [&allocation](const std::unique_ptr<VulkanMemoryBlock>& b) { return b.get() == allocation.block; });
+    if (!isLive)
+    {
+        allocation = {};
+        return;
+    }
+
+    VulkanMemoryBlock* block = allocation.block;
+    VkDeviceSize offset = allocation.offset;
+    VkDeviceSize size = allocation.size;
+
+    // Merge with the free neighbours on both sides, so freed space never stays split into unusable pieces
+    auto next = block->freeRanges.lower_bound(offset);
+    if (next != block->freeRanges.end() && next->first == offset + size)
+    {
+        size += next->second;
+        next = block->freeRanges.erase(next);
+    }
+
+    if (next != block->freeRanges.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            block->freeRanges.erase(previous);
+        }
+    }
+
+    block->freeRanges[offset] = size;
+    block->allocationCount--;
+
+    // Resizes, recreated targets and staging free and allocate again right away, so one empty block per memory type
+    // and kind is kept for them. Of two empty blocks the larger one stays, it fits more. The rest goes back to the driver
+    if (block->allocationCount == 0)
+    {
+        auto otherEmptyBlock = std::find_if(m_blocks.begin(), m_blocks.end(), [block](const std::unique_ptr<VulkanMemoryBlock>& b) {
+            return b.get() != block && b->allocationCount == 0 && b->memoryTypeIndex == block->memoryTypeIndex && b->isImage == block->isImage;
+        });
+
+        if (otherEmptyBlock != m_blocks.end())
+            destroyBlock((*otherEmptyBlock)->size < block->size ? otherEmptyBlock->get() : block);
+    }
+
+    allocation = {};
+}
+
+void VulkanMemoryAllocator::flush(const VulkanAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (allocation.mappedData == nullptr || (allocation.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+        return;
+
+    // Ranges are relative to the block and must start and end on nonCoherentAtomSize, or end at the end of the block.
+    // Rounding may touch neighbouring allocations, flushing their bytes as well is harmless
+    const VkDeviceSize atomSize = m_vulkanWindow->physicalDeviceProperties()->limits.nonCoherentAtomSize;
+    VkDeviceSize start = allocation.offset + offset;
+    VkDeviceSize end = start + size;
+    start = start - start % atomSize;
+    end = (end + atomSize - 1) / atomSize * atomSize;
+
+    VkMappedMemoryRange range = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .pNext = nullptr,
+        .memory = allocation.memory,
+        .offset = start,
+        .size = end >= allocation.block->size ? VK_WHOLE_SIZE : end - start
+    };
+
+    VkResult result = m_deviceFunctions->vkFlushMappedMemoryRanges(m_device, 1, &range);
+    if (result != VK_SUCCESS)
+        qWarning("Failed to flush mapped memory (error code: %d)", result);
+}
+
+VulkanMemoryStatistics VulkanMemoryAllocator::getStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    VulkanMemoryStatistics statistics{};
+    for (const std::unique_ptr<VulkanMemoryBlock>& block : m_blocks)
+    {
+        VkDeviceSize freeBytes = 0;
+        for (const auto& [rangeOffset, rangeSize] : block->freeRanges)
+        {
+            freeBytes += rangeSize;
+            statistics.largestFreeRange = std::max(statistics.largestFreeRange, rangeSize);
+        }
+
+        statistics.blockCount++;
+        statistics.allocationCount += block->allocationCount;
+        statistics.blockBytes += block->size;
+        statistics.usedBytes += block->size - freeBytes;
+    }
+
+    return statistics;
+}
+
+void VulkanMemoryAllocator::logStatistics()
+{
+    VulkanMemoryStatistics statistics = getStatistics();
+
+    qDebug("Device memory: %u allocations in %u blocks, %.1f of %.1f MiB used, largest free range %.1f MiB",
+           statistics.allocationCount, statistics.blockCount,
+           double(statistics.usedBytes) / (1024.0 * 1024.0), double(statistics.blockBytes) / (1024.0 * 1024.0),
+           double(statistics.largestFreeRange) / (1024.0 * 1024.0));
+}
+
+void VulkanMemoryAllocator::destroy()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t usedBlockCount = std::count_if(m_blocks.begin(), m_blocks.end(), 
+                                          [](const std::unique_ptr<VulkanMemoryBlock>& b) { return b->allocationCount > 0; });
+    if (usedBlockCount > 0)
+        qWarning("Destroying %zu memory blocks that are still in use", usedBlockCount);
+
+    while (!m_blocks.empty())
+        destroyBlock(m_blocks.back().get());
+}
\ No newline at end of file
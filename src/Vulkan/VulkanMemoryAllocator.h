@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <QVulkanDeviceFunctions>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class VulkanWindow;
+struct VulkanMemoryBlock;
+
+// A range of a shared VkDeviceMemory block, returned by VulkanMemoryAllocator::allocate()
+struct VulkanAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    VkMemoryPropertyFlags propertyFlags = 0;
+    void* mappedData = nullptr; // Host-visible blocks stay mapped, this points at offset within them
+
+    VulkanMemoryBlock* block = nullptr;
+};
+
+struct VulkanMemoryStatistics
+{
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    VkDeviceSize blockBytes = 0;        // Reserved with vkAllocateMemory
+    VkDeviceSize usedBytes = 0;         // Handed out to buffers and images
+    VkDeviceSize largestFreeRange = 0;
+};
+
+// Sub-allocates buffers and images from large blocks, one set of blocks per memory type and resource kind.
+// Linear (buffer) and optimal (image) resources never share a block, so bufferImageGranularity can not be violated.
+// Free ranges are kept sorted and merged with their neighbours, allocation takes the best fit. One empty block per
+// memory type and kind is kept for reuse until destroy(). Thread-safe
+class VulkanMemoryAllocator
+{
+public:
+    VulkanMemoryAllocator(VulkanWindow* vulkanWindow);
+    ~VulkanMemoryAllocator();
+
+    VulkanMemoryAllocator(const VulkanMemoryAllocator&) = delete;
+    VulkanMemoryAllocator& operator=(const VulkanMemoryAllocator&) = delete;
+
+    // Returns an allocation with memory == VK_NULL_HANDLE on failure
+    VulkanAllocation allocate(const VkMemoryRequirements& memoryRequirements, uint32_t memoryTypeIndex, bool isImage);
+    void free(VulkanAllocation& allocation);
+
+    // Makes host writes to [offset, offset + size) of the allocation visible, a no-op on coherent memory
+    void flush(const VulkanAllocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+    VulkanMemoryStatistics getStatistics();
+    void logStatistics();
+
+    // Frees every block including the empty ones kept for reuse, only valid once all buffers and images are gone
+    void destroy();
+
+private:
+    void initialize();
+    VulkanMemoryBlock* createBlock(uint32_t memoryTypeIndex, bool isImage, VkDeviceSize size);
+    void destroyBlock(VulkanMemoryBlock* block);
+
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    VulkanWindow* m_vulkanWindow = nullptr;
+
+    std::mutex m_mutex{};
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+    std::vector<std::unique_ptr<VulkanMemoryBlock>> m_blocks{};
+
+    VkResult m_result = VK_NOT_READY;
+    QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
+};
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "VulkanPipelineCache.h"
+#include "VulkanWindow.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+// Written in front of the driver's data, VkPipelineCacheHeaderVersionOne has no driver version of its own
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x50435654; // "TVCP"
+
+// FNV-1a, catches files that were cut short or damaged since they were written
+static uint64_t hashData(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) 
+    {
+        hash ^= uint8_t(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static PipelineCacheFileHeader deviceHeader(const VkPhysicalDeviceProperties* properties)
+{
+    PipelineCacheFileHeader header{};
+    header.magic            = PIPELINE_CACHE_MAGIC;
+    header.vendorID         = properties->vendorID;
+    header.deviceID         = properties->deviceID;
+    header.driverVersion    = properties->driverVersion;
+    std::memcpy(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE);
+    return header;
+}
+
+VulkanPipelineCache::VulkanPipelineCache(VulkanWindow* vulkanWindow, const QString& name)
+    : m_vulkanWindow(vulkanWindow)
+{
+    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_vulkanWindow->device());
+
+    QString cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!cacheDirectory.isEmpty()) 
+        m_filePath = QDir(cacheDirectory).filePath(QStringLiteral("pipeline_cache_%1.bin").arg(name));
+
+    createPipelineCache();
+}
+
+VulkanPipelineCache::~VulkanPipelineCache()
+{
+    cleanup();
+}
+
+void VulkanPipelineCache::swap(VulkanPipelineCache& other) noexcept
+{
+    std::swap(m_vulkanWindow, other.m_vulkanWindow);
+    std::swap(m_filePath, other.m_filePath);
+    
+    // Vulkan resources
+    std::swap(m_pipelineCache, other.m_pipelineCache);
+    
+    // Device resources
+    std::swap(m_result, other.m_result);
+    std::swap(m_deviceFunctions, other.m_deviceFunctions);
+}
+
+VulkanPipelineCache& VulkanPipelineCache::operator=(VulkanPipelineCache&& other) noexcept 
+{
+    if (this != &other) 
+    {
+        cleanup();
+        swap(other);
+    }
+    return *this;
+}
+
+QByteArray VulkanPipelineCache::loadCacheData()
+{
+    if (m_filePath.isEmpty()) 
+        return {};
+
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) 
+        return {}; // First launch
+
+    QByteArray contents = file.readAll();
+    file.close();
+
+    PipelineCacheFileHeader header{};
+    if (size_t(contents.size()) < sizeof(header)) 
+    {
+        qWarning("Ignoring truncated pipeline cache %s", qPrintable(m_filePath));
+        return {};
+    }
+    std::memcpy(&header, contents.constData(), sizeof(header));
+
+    // A new driver or another GPU may reject the data or, worse, misread it
+    PipelineCacheFileHeader expected = deviceHeader(m_vulkanWindow->physicalDeviceProperties());
+    if (header.magic != expected.magic || 
+        header.vendorID != expected.vendorID || 
+        header.deviceID != expected.deviceID || 
+        header.driverVersion != expected.driverVersion || 
+        std::memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) 
+    {
+        qDebug("Pipeline cache %s was written for another device or driver, starting empty", qPrintable(m_filePath));
+        return {};
+    }
+
+    const char* data = contents.constData() + sizeof(header);
+    if (header.dataSize != uint64_t(contents.size()) - sizeof(header) || header.dataHash != hashData(data, header.dataSize)) 
+    {
+        qWarning("Ignoring damaged pipeline cache %s", qPrintable(m_filePath));
+        return {};
+    }
+
+    return QByteArray(data, qsizetype(header.dataSize));
+}
+
+void VulkanPipelineCache::createPipelineCache()
+{
+    QByteArray initialData = loadCacheData();
+
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .initialDataSize = size_t(initialData.size()),
+        .pInitialData = initialData.isEmpty() ? nullptr : initialData.constData()
+    };
+
+    m_result = m_deviceFunctions->vkCreatePipelineCache(m_vulkanWindow->device(), &pipelineCacheCreateInfo, nullptr, &m_pipelineCache);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create pipeline cache (error code: %d)", m_result);
+        return;
+    }
+
+    qDebug("Pipeline cache %s: %lld bytes loaded", qPrintable(m_filePath), qlonglong(initialData.size()));
+}
+
+void VulkanPipelineCache::save()
+{
+    if (m_pipelineCache == VK_NULL_HANDLE || m_filePath.isEmpty()) 
+        return;
+
+    size_t dataSize = 0;
+    m_result = m_deviceFunctions->vkGetPipelineCacheData(m_vulkanWindow->device(), m_pipelineCache, &dataSize, nullptr);
+    if (m_result != VK_SUCCESS || dataSize == 0)
+        return;
+
+    QByteArray contents(qsizetype(sizeof(PipelineCacheFileHeader) + dataSize), Qt::Uninitialized);
+    char* data = contents.data() + sizeof(PipelineCacheFileHeader);
+
+    m_result = m_deviceFunctions->vkGetPipelineCacheData(m_vulkanWindow->device(), m_pipelineCache, &dataSize, data);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to read pipeline cache data (error code: %d)", m_result);
+        return;
+    }
+
+    PipelineCacheFileHeader header = deviceHeader(m_vulkanWindow->physicalDeviceProperties());
+    header.dataSize = dataSize;
+    header.dataHash = hashData(data, dataSize);
+    std::memcpy(contents.data(), &header, sizeof(header));
+
+    // QSaveFile only replaces the old file once everything is written, a crash here leaves the previous cache intact
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents.constData(), qsizetype(sizeof(header) + dataSize)) < 0 || !file.commit()) 
+    {
+        qWarning("Failed to write pipeline cache %s", qPrintable(m_filePath));
+        return;
+    }
+
+    qDebug("Pipeline cache %s: %zu bytes saved", qPrintable(m_filePath), dataSize);
+}
+
+void VulkanPipelineCache::cleanup()
+{
+    if (m_pipelineCache != VK_NULL_HANDLE)
+    {
+        save();
+
+        m_deviceFunctions->vkDestroyPipelineCache(m_vulkanWindow->device(), m_pipelineCache, nullptr);
+        m_pipelineCache = VK_NULL_HANDLE;
+    }
+}
\ No newline at end of file
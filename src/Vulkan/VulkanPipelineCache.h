@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <QVulkanDeviceFunctions>
+#include <QString>
+
+class VulkanWindow;
+
+// VkPipelineCache backed by a file in the user cache directory. The file is only used when it was written for the
+// same device (vendor, device ID, pipeline cache UUID) and driver version, and is written back when the cache is destroyed
+class VulkanPipelineCache 
+{
+public:
+    VulkanPipelineCache() = default;
+    VulkanPipelineCache(VulkanWindow* vulkanWindow, const QString& name);
+    ~VulkanPipelineCache();
+
+    VulkanPipelineCache& operator=(VulkanPipelineCache&& other) noexcept;
+
+    VkPipelineCache getPipelineCache() const { return m_pipelineCache; }
+
+    void save();
+    void destroy() { cleanup(); }
+
+private:
+    void createPipelineCache();
+    QByteArray loadCacheData();
+    void cleanup();
+    void swap(VulkanPipelineCache& other) noexcept;
+
+    VulkanWindow* m_vulkanWindow = nullptr;
+    QString m_filePath{};
+
+    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    
+    VkResult m_result = VK_NOT_READY;
+    QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
+};
\ No newline at end of file
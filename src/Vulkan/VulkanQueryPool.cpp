@@ -0,0 +1,101 @@
+#include "VulkanQueryPool.h"
+#include "VulkanWindow.h"
+#include <QVulkanFunctions>
+
+VulkanQueryPool::VulkanQueryPool(VulkanWindow* vulkanWindow, uint32_t queryCount)
+    : m_vulkanWindow(vulkanWindow),
+      m_queryCount(queryCount)
+{
+    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_vulkanWindow->device());
+
+    createQueryPool();
+}
+
+VulkanQueryPool::~VulkanQueryPool()
+{
+    cleanup();
+}
+
+void VulkanQueryPool::swap(VulkanQueryPool& other) noexcept
+{
+    std::swap(m_vulkanWindow, other.m_vulkanWindow);
+    std::swap(m_queryCount, other.m_queryCount);
+    
+    // Vulkan resources
+    std::swap(m_queryPool, other.m_queryPool);
+    
+    // Device resources
+    std::swap(m_result, other.m_result);
+    std::swap(m_deviceFunctions, other.m_deviceFunctions);
+}
+
+VulkanQueryPool& VulkanQueryPool::operator=(VulkanQueryPool&& other) noexcept 
+{
+    if (this != &other) 
+    {
+        cleanup();
+        swap(other);
+    }
+    return *this;
+}
+
+void VulkanQueryPool::createQueryPool()
+{
+    VkQueryPoolCreateInfo queryPoolCreateInfo
+    {
+        .sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext              = nullptr,
+        .flags              = 0,
+        .queryType          = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount         = m_queryCount,
+        .pipelineStatistics = 0
+    };
+
+    m_result = m_deviceFunctions->vkCreateQueryPool(m_vulkanWindow->device(), &queryPoolCreateInfo, nullptr, &m_queryPool);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create query pool (error code: %d)", m_result);
+        return;
+    }
+}
+
+void VulkanQueryPool::reset(VkCommandBuffer commandBuffer, uint32_t firstQuery, uint32_t queryCount)
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+        return;
+
+    m_deviceFunctions->vkCmdResetQueryPool(commandBuffer, m_queryPool, firstQuery, queryCount);
+}
+
+void VulkanQueryPool::writeTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query)
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+        return;
+
+    m_deviceFunctions->vkCmdWriteTimestamp(commandBuffer, stage, m_queryPool, query);
+}
+
+bool VulkanQueryPool::getResults(uint32_t firstQuery, uint32_t queryCount, uint64_t* results)
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+        return false;
+
+    m_result = m_deviceFunctions->vkGetQueryPoolResults(m_vulkanWindow->device(), m_queryPool, firstQuery, queryCount,
+                                                        queryCount * sizeof(uint64_t), results, sizeof(uint64_t),
+                                                        VK_QUERY_RESULT_64_BIT);
+
+    // VK_NOT_READY is expected for queries that have not executed yet
+    if (m_result != VK_SUCCESS && m_result != VK_NOT_READY)
+        qWarning("Failed to read query pool results (error code: %d)", m_result);
+
+    return m_result == VK_SUCCESS;
+}
+
+void VulkanQueryPool::cleanup()
+{
+    if (m_queryPool != VK_NULL_HANDLE)
+    {
+        m_deviceFunctions->vkDestroyQueryPool(m_vulkanWindow->device(), m_queryPool, nullptr);
+        m_queryPool = VK_NULL_HANDLE;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <QVulkanDeviceFunctions>
+
+class VulkanWindow;
+
+// Timestamp queries, ticks are converted with VkPhysicalDeviceLimits::timestampPeriod by the caller
+class VulkanQueryPool 
+{
+public:
+    VulkanQueryPool() = default;
+    VulkanQueryPool(VulkanWindow* vulkanWindow, uint32_t queryCount);
+    ~VulkanQueryPool();
+
+    VulkanQueryPool& operator=(VulkanQueryPool&& other) noexcept;
+
+    VkQueryPool getQueryPool() const { return m_queryPool; }
+
+    void reset(VkCommandBuffer commandBuffer, uint32_t firstQuery, uint32_t queryCount);
+    void writeTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query);
+
+    // Does not wait, returns false while any of the queries is still unavailable
+    bool getResults(uint32_t firstQuery, uint32_t queryCount, uint64_t* results);
+
+    void destroy() { cleanup(); }
+
+private:
+    void createQueryPool();
+    void cleanup();
+    void swap(VulkanQueryPool& other) noexcept;
+
+    VulkanWindow* m_vulkanWindow = nullptr;
+    uint32_t m_queryCount{};
+
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    
+    VkResult m_result = VK_NOT_READY;
+    QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
+};
\ No newline at end of file
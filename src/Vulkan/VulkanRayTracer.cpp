@@ -4,26 +4,70 @@
 #include "VulkanBuffer.h"
 #include "VulkanCommandBuffer.h"
 #include "VulkanCommandPool.h"
+#include "VulkanUploader.h"
 #include "BoundingVolumeHierarchy.h"
 #include "Light.h"
+#include "EnvironmentMap.h"
+#include "PresentationScheduler.h"
 
 #include <QThread>
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+#include <utility>
+#include <QVector4D>
 
 #include "VulkanWindow.h"
 
 struct PushConstants
 {
     uint32_t sample_batch;
+    uint32_t output_image;
+    uint32_t history_image;
+    uint32_t tile_x;
+    uint32_t tile_y;
+    uint32_t tile_width;
+    uint32_t tile_height;
+    uint32_t pixel_stride;
+    uint32_t history_mode;
+    uint32_t visibility_layers;
 };
 
 PushConstants pushConstants;
 
-static const uint64_t render_width     = 1024;
-static const uint64_t render_height    = 1024;
-static const uint32_t workgroup_width  = 16;
-static const uint32_t workgroup_height = 16;
+static const uint32_t TILE_SIZE         = 128;
 
 static const int UNIFORM_VECTOR_DATA_SIZE = 4 * sizeof(float);
+static const int UNIFORM_VECTOR_COUNT = 9; // cameraPos, cameraDir, cameraUp, fov, lens, then pos, dir, up and fov of the history camera
+
+// HISTORY_* in raytrace_comp.comp
+static const uint32_t HISTORY_NONE      = 0;
+static const uint32_t HISTORY_SAME_VIEW = 1;
+static const uint32_t HISTORY_REPROJECT = 2;
+static const VkDeviceSize RESERVOIR_SIZE = 3 * 4 * sizeof(float); // Reservoir in raytrace_comp.comp, three vec4
+static const VkDeviceSize SURFACE_FEATURE_SIZE = 8 * sizeof(float); // SurfaceFeature in raytrace_comp.comp and denoise_comp.comp, two vec4
+static const VkDeviceSize VISIBILITY_ENTRY_SIZE = sizeof(uint32_t);   // One triangle index per pixel and layer
+static const VkDeviceSize COHERENCE_STATS_SIZE = 4 * sizeof(uint32_t); // CoherenceStats in raytrace_comp.comp
+static const uint32_t MAX_SORTED_RAYS = 256; // MAX_SORTED_RAYS in raytrace_comp.comp, larger workgroups trace unsorted
+
+// Portable float map with 1 (Pf) or 3 (PF) channels, little endian. Rows are stored from the bottom of the image up
+static bool writePfm(const QString& path, uint32_t width, uint32_t height, uint32_t channels, const std::vector<float>& values)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) 
+    {
+        qWarning("Failed to write %s", qPrintable(path));
+        return false;
+    }
+
+    file.write(QStringLiteral("%1\n%2 %3\n-1.0\n").arg(QLatin1String(channels == 1 ? "Pf" : "PF")).arg(width).arg(height).toLatin1());
+
+    qint64 rowSize = qint64(width) * channels * sizeof(float);
+    for (uint32_t y = height; y-- > 0;) 
+        file.write(reinterpret_cast<const char*>(values.data() + size_t(y) * width * channels), rowSize);
+
+    return true;
+}
 
 static inline VkDeviceSize aligned(VkDeviceSize v, VkDeviceSize byteAlign)
 {
@@ -33,333 +77,219 @@ static inline VkDeviceSize aligned(VkDeviceSize v, VkDeviceSize byteAlign)
 VulkanRayTracer::VulkanRayTracer(VulkanWindow *w)
     : m_vulkanWindow(w){}
 
-void VulkanRayTracer::initRayTracer()
+VulkanRayTracer::~VulkanRayTracer()
 {
-    initComputePipeline(); 
+    stop();
 }
 
-void VulkanRayTracer::initComputePipeline()
+void VulkanRayTracer::setSettings(const RayTracerSettings& settings)
 {
-    m_device = m_vulkanWindow->device();
-    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_device);
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+    m_settings = settings;
+}
 
-    m_graphicsQueueFamilyIndex = m_vulkanWindow->findQueueFamilyIndex(m_vulkanWindow->physicalDevice(), VK_QUEUE_GRAPHICS_BIT);
-    if (m_graphicsQueueFamilyIndex == UINT32_MAX)
-        qDebug("No suitable graphics queue family found!");
+RayTracerSettings VulkanRayTracer::getSettings()
+{
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+    return m_settings;
+}
 
-    m_computeQueueFamilyIndex = m_vulkanWindow->findQueueFamilyIndex(m_vulkanWindow->physicalDevice(), VK_QUEUE_COMPUTE_BIT);
-    if (m_computeQueueFamilyIndex == UINT32_MAX)
-        qDebug("No suitable compute queue family found!");
+std::vector<float> VulkanRayTracer::takePreviewVertices()
+{
+    std::lock_guard<std::mutex> lock(m_previewMutex);
+    return std::exchange(m_previewVertices, {});
+}
 
-    m_deviceFunctions->vkGetDeviceQueue(m_device, m_computeQueueFamilyIndex, 0, &m_computeQueue);
-    m_computeCommandPool = VulkanCommandPool(m_vulkanWindow, m_computeQueueFamilyIndex);
+void VulkanRayTracer::setEnvironmentPath(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+    m_environmentPath = path;
+}
 
-    const VkPhysicalDeviceLimits *pdevLimits = &m_vulkanWindow->physicalDeviceProperties()->limits;
-    const VkDeviceSize uniAlign = pdevLimits->minUniformBufferOffsetAlignment;
+void VulkanRayTracer::requestAovExport(const QString& directory)
+{
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+    m_aovExportDirectory = directory;
+    m_aovExportRequested = true;
+}
 
-    /////////////////////////////////////////////////////////////////////
-    // Load the mesh from an OBJ file
-    /////////////////////////////////////////////////////////////////////
+void VulkanRayTracer::start()
+{
+    if (m_workerThread.joinable()) 
+        return;
 
-    tinyobj::ObjReader reader;
+    m_stopRequested = false;
+    m_running       = true;
 
-    if (!reader.ParseFromFile("../scenes/Sylveon.obj")) { // TODO: Better scene loading
-        qDebug() << "Failed to load .obj: " << reader.Error();
-    }
+    // Scene preparation and accumulation both run here, the GUI thread keeps presenting
+    m_workerThread = std::thread([this]() {
+        if (initComputePipeline() && !m_stopRequested) 
+            mainLoop();
+        else if (!m_stopRequested) 
+            qWarning("Ray tracer initialization failed");
 
-    const std::vector<tinyobj::real_t>& objVertices = reader.GetAttrib().GetVertices(); // [x0, y0, z0, x1, y1, z1, ...]
-    const std::vector<tinyobj::real_t>& objUVs = reader.GetAttrib().texcoords; // [u, v, u, v, ...]
-    const std::vector<tinyobj::shape_t>& objShapes = reader.GetShapes(); // All shapes in the file
+        releaseComputePipeline();
+        m_running = false;
+    });
+}
 
-    // Store indices from all shapes
-    std::vector<uint32_t> objIndices; // [v0, v1, v2, v0, v1, v2, ...]
+void VulkanRayTracer::requestStop()
+{
+    m_stopRequested = true;
+}
 
-    for (const tinyobj::shape_t& objShape : objShapes) {
-        for (const tinyobj::index_t& index : objShape.mesh.indices) {
-            objIndices.push_back(index.vertex_index);
-        }
-    }
+void VulkanRayTracer::stop()
+{
+    requestStop();
 
-    // Store material indices from all shapes
-    std::vector<uint32_t> matIndices; // [matIdx0, matIdx1, ...] (one per triangle)
+    if (m_workerThread.joinable()) 
+        m_workerThread.join();
+}
 
-    for (const tinyobj::shape_t& shape : objShapes) 
+void VulkanRayTracer::releaseComputePipeline()
+{
+    if (!m_deviceFunctions) 
+        return;
+
+    // Batches are submitted and waited on by this thread, but the queue may still hold the last one
+    if (m_computeQueue) 
     {
-        for (int matId : shape.mesh.material_ids) 
-        {
-            matIndices.push_back(matId >= 0 ? static_cast<uint32_t>(matId) : 0);
-        }
+        auto sharedQueueLock = m_vulkanWindow->lockSharedQueue();
+        m_deviceFunctions->vkQueueWaitIdle(m_computeQueue);
     }
 
-    BVH bvh(objVertices, objIndices);
-
-    /////////////////////////////////////////////////////////////////////
-    // Buffer setup
-    /////////////////////////////////////////////////////////////////////
-
-    // Setup vertex buffer
-    VkDeviceSize vertexSize = bvh.getVertices().size() * sizeof(tinyobj::real_t);
-    m_vertexBuffer          = VulkanBuffer(m_vulkanWindow, 
-                                            vertexSize,
-                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                            m_vulkanWindow->deviceLocalMemoryIndex());
-        
-    m_vertexStagingBuffer   = VulkanBuffer(m_vulkanWindow, 
-                                            vertexSize,
-                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                            m_vulkanWindow->hostVisibleMemoryIndex());
-
-    m_vertexStagingBuffer.copyData(bvh.getVertices().data(), vertexSize); 
-
-    // Setup index buffer
-    VkDeviceSize indexSize  = bvh.getIndices().size() * sizeof(uint32_t);
-    m_indexBuffer           = VulkanBuffer(m_vulkanWindow, 
-                                            indexSize,
-                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                            m_vulkanWindow->deviceLocalMemoryIndex());
-        
-    m_indexStagingBuffer    = VulkanBuffer(m_vulkanWindow, 
-                                            indexSize,
-                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                            m_vulkanWindow->hostVisibleMemoryIndex());
-
-    m_indexStagingBuffer.copyData(bvh.getIndices().data(), indexSize); 
-
-    // Setup BVH buffer
-    VkDeviceSize BVHSize    = bvh.getNodes().size() * sizeof(BVHNode);
-    m_BVHBuffer             = VulkanBuffer(m_vulkanWindow, 
-                                            BVHSize,
-                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                            m_vulkanWindow->deviceLocalMemoryIndex());
-        
-    m_BVHStagingBuffer      = VulkanBuffer(m_vulkanWindow, 
-                                            BVHSize,
-                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                            m_vulkanWindow->hostVisibleMemoryIndex());
-
-    m_BVHStagingBuffer.copyData(bvh.getNodes().data(), BVHSize); 
-
-    const VkDeviceSize uniformBufferDeviceSize = aligned(UNIFORM_VECTOR_DATA_SIZE, uniAlign) * 4;
-    m_uniformBuffer         = VulkanBuffer(m_vulkanWindow, 
-                                            uniformBufferDeviceSize, 
-                                            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-                                            m_vulkanWindow->hostVisibleMemoryIndex());
-
-    // Prepare light data
-    std::vector<glm::vec3> positions = {
-        glm::vec3(0.0f, 2.0f, 0.0f),
-    };
-    std::vector<glm::vec3> normals = {
-        glm::vec3(0.0f, -1.0f, 0.0f),
-    };
-    std::vector<glm::vec3> intensities = {
-        glm::vec3(10.0f, 10.0f, 10.0f),
-    };
-    std::vector<glm::vec2> sizes = {
-        glm::vec2(2.5f, 2.5f),
-    };
-
-    Light lights(positions, normals, intensities, sizes);
-
-    // Setup light buffer
-    VkDeviceSize lightSize  = lights.getLights().size() * sizeof(AreaLightData);
-    m_lightBuffer           = VulkanBuffer(m_vulkanWindow, 
-                                            lightSize,
-                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                            m_vulkanWindow->deviceLocalMemoryIndex());
-        
-    m_lightStagingBuffer    = VulkanBuffer(m_vulkanWindow, 
-                                            lightSize,
-                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                            m_vulkanWindow->hostVisibleMemoryIndex());
-
-    m_lightStagingBuffer.copyData(lights.getLights().data(), lightSize); 
-
-    // Setup UV buffer
-    VkDeviceSize UVSize     = objUVs.size() * sizeof(tinyobj::real_t);
-    m_UVBuffer              = VulkanBuffer(m_vulkanWindow, 
-                                            UVSize,
-                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                            m_vulkanWindow->deviceLocalMemoryIndex());
-        
-    m_UVStagingBuffer       = VulkanBuffer(m_vulkanWindow, 
-                                            UVSize,
-                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                            m_vulkanWindow->hostVisibleMemoryIndex());
-
-    m_UVStagingBuffer.copyData(objUVs.data(), UVSize); 
-
-    // Setup material index buffer
-    VkDeviceSize materialIndexSize  = matIndices.size() * sizeof(uint32_t);
-    m_materialIndexBuffer           = VulkanBuffer(m_vulkanWindow, 
-                                            materialIndexSize,
-                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                            m_vulkanWindow->deviceLocalMemoryIndex());
-        
-    m_materialIndexStagingBuffer    = VulkanBuffer(m_vulkanWindow, 
-                                            materialIndexSize,
-                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                            m_vulkanWindow->hostVisibleMemoryIndex());
-
-    m_materialIndexStagingBuffer.copyData(matIndices.data(), materialIndexSize); 
+    // The renderer has stopped drawing by now
+    destroyRetiredImages(true);
 
-    /////////////////////////////////////////////////////////////////////
-    // Copy staging buffers to device local memory buffers
-    /////////////////////////////////////////////////////////////////////
+    destroyComputePipelines();
+    m_denoiser.destroy();
 
+    if (m_reloadPipeline.valid()) 
     {
-        VulkanCommandBuffer commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
-
-        commandBuffer.beginSingleTimeCommandBuffer();
-
-        // Copy vertex staging buffer to vertex buffer
-
-            VkBufferCopy vertexBufferCopyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = vertexSize
-        };
-
-        m_deviceFunctions->vkCmdCopyBuffer(commandBuffer.getCommandBuffer(), 
-                                            m_vertexStagingBuffer.getBuffer(), 
-                                            m_vertexBuffer.getBuffer(), 
-                                            1, &vertexBufferCopyRegion);
-
-        // Copy index staging buffer to index buffer
+        VkPipeline reloadPipeline = m_reloadPipeline.get();
+        if (reloadPipeline) 
+            m_deviceFunctions->vkDestroyPipeline(m_device, reloadPipeline, nullptr);
+    }
 
-        VkBufferCopy indexBufferCopyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = indexSize
-        };
+    for (VkShaderModule* shaderModule : { &m_reloadShaderModule, &m_reloadStatsShaderModule }) 
+    {
+        if (*shaderModule) 
+            m_deviceFunctions->vkDestroyShaderModule(m_device, *shaderModule, nullptr);
+        *shaderModule = VK_NULL_HANDLE;
+    }
 
-        m_deviceFunctions->vkCmdCopyBuffer(commandBuffer.getCommandBuffer(), 
-                                            m_indexStagingBuffer.getBuffer(), 
-                                            m_indexBuffer.getBuffer(), 
-                                            1, &indexBufferCopyRegion);
+    // Written back to disk here, the next launch starts from it
+    m_pipelineCache.destroy();
 
-        // Copy BVH staging buffer to BVH buffer
+    for (VkShaderModule* shaderModule : { &m_computeShaderModule, &m_statsShaderModule }) 
+    {
+        if (*shaderModule) 
+            m_deviceFunctions->vkDestroyShaderModule(m_device, *shaderModule, nullptr);
+        *shaderModule = VK_NULL_HANDLE;
+    }
 
-            VkBufferCopy BVHBufferCopyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = BVHSize
-        };
+    if (m_pipelineLayout) 
+    {
+        m_deviceFunctions->vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+        m_pipelineLayout = VK_NULL_HANDLE;
+    }
 
-        m_deviceFunctions->vkCmdCopyBuffer(commandBuffer.getCommandBuffer(), 
-                                            m_BVHStagingBuffer.getBuffer(), 
-                                            m_BVHBuffer.getBuffer(), 
-                                            1, &BVHBufferCopyRegion);
+    if (m_descriptorPool) 
+    {
+        m_deviceFunctions->vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+        m_descriptorPool = VK_NULL_HANDLE;
+        m_descriptorSet = VK_NULL_HANDLE;
+    }
 
-        // Copy light staging buffer to light buffer
+    if (m_descriptorSetLayout) 
+    {
+        m_deviceFunctions->vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+        m_descriptorSetLayout = VK_NULL_HANDLE;
+    }
 
-        VkBufferCopy lightBufferCopyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = lightSize
-        };
+    for (VulkanBuffer* buffer : { &m_vertexBuffer, &m_indexBuffer, &m_BVHBuffer, &m_lightBuffer,
+                                  &m_UVBuffer, &m_materialIndexBuffer, &m_emissiveTriangleBuffer, &m_lightSamplerBuffer,
+                                  &m_materialBuffer, &m_environmentBuffer, &m_environmentDistributionBuffer, &m_reservoirBuffer,
+                                  &m_surfaceFeatureBuffer, &m_visibilityBuffer, &m_coherenceStatsBuffer })
+        buffer->destroy();
+    m_visibilityLayers = 0;
+    m_uniformRing.destroy();
 
-        m_deviceFunctions->vkCmdCopyBuffer(commandBuffer.getCommandBuffer(), 
-                                            m_lightStagingBuffer.getBuffer(), 
-                                            m_lightBuffer.getBuffer(), 
-                                            1, &lightBufferCopyRegion);
+    {
+        std::lock_guard<std::mutex> lock(m_displayMutex);
+        m_latestImage       = -1;
+        m_displayedImage    = -1;
+        m_writtenImage      = -1;
+        m_imageRetireFrames.fill(0);
+        m_imageOwners.fill(ImageOwner::Compute);
+        m_publishedDenoised.fill(false);
+    }
 
-        // Copy UV staging buffer to vertex buffer
+    for (VulkanImage& accumulationImage : m_accumulationImages) 
+        accumulationImage.destroy();
+    for (VulkanImage& denoisedImage : m_denoisedImages) 
+        denoisedImage.destroy();
+    m_triangleIdImage.destroy();
+    m_aovMask = 0;
+
+    for (VulkanCommandBuffer& commandBuffer : m_batchCommandBuffers) 
+        commandBuffer.destroy();
+    m_computeCommandPool.destroy();
+    m_batchTimeline.destroy();
+    m_timestampQueries.destroy();
+}
 
-        VkBufferCopy UVBufferCopyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = UVSize
-        };
+bool VulkanRayTracer::initComputePipeline()
+{
+    m_device = m_vulkanWindow->device();
+    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_device);
 
-        m_deviceFunctions->vkCmdCopyBuffer(commandBuffer.getCommandBuffer(), 
-                                            m_UVStagingBuffer.getBuffer(), 
-                                            m_UVBuffer.getBuffer(), 
-                                            1, &UVBufferCopyRegion);
+    // Queue picked by VulkanWindow's queue create modifier, separate from the one Qt renders with whenever the device allows
+    m_graphicsQueueFamilyIndex = m_vulkanWindow->graphicsQueueFamilyIndex();
+    m_computeQueueFamilyIndex = m_vulkanWindow->getComputeQueueFamilyIndex();
+    if (m_computeQueueFamilyIndex == UINT32_MAX)
+        qDebug("No suitable compute queue family found!");
 
-        // Copy material index staging buffer to material index buffer
+    m_deviceFunctions->vkGetDeviceQueue(m_device, m_computeQueueFamilyIndex, m_vulkanWindow->getComputeQueueIndex(), &m_computeQueue);
+    m_computeCommandPool = VulkanCommandPool(m_vulkanWindow, m_computeQueueFamilyIndex, 
+                                                VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-        VkBufferCopy materialIndexBufferCopyRegion = {
-            .srcOffset = 0,
-            .dstOffset = 0,
-            .size = materialIndexSize
-        };
+    for (VulkanCommandBuffer& commandBuffer : m_batchCommandBuffers) 
+        commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
 
-        m_deviceFunctions->vkCmdCopyBuffer(commandBuffer.getCommandBuffer(), 
-                                            m_materialIndexStagingBuffer.getBuffer(), 
-                                            m_materialIndexBuffer.getBuffer(), 
-                                            1, &materialIndexBufferCopyRegion);
+    m_batchTimeline         = VulkanTimelineSemaphore(m_vulkanWindow);
+    m_batchTimelineValue    = 0;
+    m_batchSlotValues.fill(0);
 
-        VkMemoryBarrier memoryBarrier = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-            .pNext = nullptr,
-            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
-        };
+    // Two timestamps per submit slot bracket its dispatches. Without timestamp support the tile count stays at its initial value
+    m_tileTimeNs        = 0.0;
+    m_tilesPerSubmit    = 4;
+    uint32_t queueFamilyCount = 0;
+    m_vulkanWindow->vulkanInstance()->functions()->vkGetPhysicalDeviceQueueFamilyProperties(m_vulkanWindow->physicalDevice(), &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    m_vulkanWindow->vulkanInstance()->functions()->vkGetPhysicalDeviceQueueFamilyProperties(m_vulkanWindow->physicalDevice(), &queueFamilyCount, queueFamilies.data());
 
-        m_deviceFunctions->vkCmdPipelineBarrier(
-            commandBuffer.getCommandBuffer(),
-            VK_PIPELINE_STAGE_TRANSFER_BIT,         
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,    
-            0,
-            1, &memoryBarrier,  // Global memory barrier
-            0, nullptr,
-            0, nullptr
-        );
-        
-        commandBuffer.endSubmitAndWait();
-    }
+    if (m_computeQueueFamilyIndex < queueFamilyCount && queueFamilies[m_computeQueueFamilyIndex].timestampValidBits > 0) 
+        m_timestampQueries = VulkanQueryPool(m_vulkanWindow, 2 * BATCHES_IN_FLIGHT);
+    else 
+        qDebug("Compute queue has no timestamps, submitting %u tiles at a time", m_tilesPerSubmit);
 
-    /////////////////////////////////////////////////////////////////////
-    // Create image
-    /////////////////////////////////////////////////////////////////////
+    m_timestampPeriod = m_vulkanWindow->physicalDeviceProperties()->limits.timestampPeriod;
+    m_slotTileCounts.fill(0);
+    m_slotPixelStrides.fill(1);
 
-    m_storageImage = VulkanImage(m_vulkanWindow, 
-                                    render_width, render_height, 
-                                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                                    m_vulkanWindow->deviceLocalMemoryIndex());
+    const VkPhysicalDeviceLimits *pdevLimits = &m_vulkanWindow->physicalDeviceProperties()->limits;
+    const VkDeviceSize uniAlign = pdevLimits->minUniformBufferOffsetAlignment;
 
     /////////////////////////////////////////////////////////////////////
-    // Set up descriptor set and its layout
+    // Compute pipeline setup
     /////////////////////////////////////////////////////////////////////
 
-    VkDescriptorPoolSize descriptorPoolSizes[]
-    {
-        {
-            .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            .descriptorCount = 1  // For the storage image
-        },
-        {
-            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = 6  // For vertex, UV, index, material index, BVH and light buffers
-        },
-        {
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1  // For camera data  
-        }
-    };
-
-    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
-        .maxSets = 1,              // Still one descriptor set
-        .poolSizeCount = 3,
-        .pPoolSizes = descriptorPoolSizes
-    };
-
-    m_result = m_deviceFunctions->vkCreateDescriptorPool(m_device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
-    if (m_result != VK_SUCCESS)
-    {
-        qWarning("Failed to create descriptor pool (error code: %d)", m_result);
-        return;
-    }
-
     VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[] = {
-        {   // Binding 0: Storage Image
+        {   // Binding 0: Accumulation Images
             .binding = 0,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            .descriptorCount = 1,
+            .descriptorCount = ACCUMULATION_IMAGE_COUNT,
             .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
             .pImmutableSamplers = nullptr
         },
@@ -384,9 +314,9 @@ void VulkanRayTracer::initComputePipeline()
             .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
             .pImmutableSamplers = nullptr
         },
-        {   // Binding 4: Uniform Buffer
+        {   // Binding 4: Uniform Buffer, offset per submit
             .binding = 4,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
             .descriptorCount = 1,
             .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
             .pImmutableSamplers = nullptr
@@ -412,46 +342,480 @@ void VulkanRayTracer::initComputePipeline()
             .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
             .pImmutableSamplers = nullptr
         },
+        {   // Binding 8: Emissive Triangle Buffer (SSBO)
+            .binding = 8,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 9: Light Sampler Buffer (SSBO)
+            .binding = 9,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 10: Material Buffer (SSBO)
+            .binding = 10,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 11: Environment Texel Buffer (SSBO)
+            .binding = 11,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 12: Environment Distribution Buffer (SSBO)
+            .binding = 12,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 13: Reservoir Buffer (SSBO)
+            .binding = 13,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 14: Surface Feature Buffer (SSBO)
+            .binding = 14,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 15: Triangle ID AOV Image
+            .binding = 15,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 16: Visibility Buffer (SSBO)
+            .binding = 16,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+        {   // Binding 17: Coherence Stats Buffer (SSBO)
+            .binding = 17,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = nullptr
+        },
+    };
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo 
+    {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .bindingCount = sizeof(descriptorSetLayoutBinding) / sizeof(VkDescriptorSetLayoutBinding),
+        .pBindings = descriptorSetLayoutBinding
+    };
+
+    m_result = m_deviceFunctions->vkCreateDescriptorSetLayout(m_device, &descriptorSetLayoutCreateInfo, nullptr, &m_descriptorSetLayout);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create descriptor set layout (error code: %d)", m_result);
+        return false;
+    }
+
+    /////////////////////////////////////////////////////////////////////
+    // Pipeline cache, layout and the first variant
+    /////////////////////////////////////////////////////////////////////
+
+    // Warm after the first launch, the driver then skips most of the raytrace_comp compile
+    m_pipelineCache = VulkanPipelineCache(m_vulkanWindow, QStringLiteral("raytracer"));
+
+    // Its targets are only created once denoising is enabled, a denoiser that failed here just leaves it off
+    m_denoiser = VulkanDenoiser(m_vulkanWindow, m_pipelineCache.getPipelineCache());
+
+    // The embedded SPIR-V unless a reloaded shader replaced it earlier
+    m_subgroupStatsSupported = querySubgroupStatsSupport();
+    m_shaderReloadRequested = false;
+    if (!createShaderModules(m_computeShaderModule, m_statsShaderModule)) 
+        return false;
+
+    VkPushConstantRange pushConstantRange
+    {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset     = 0,                              
+        .size       = sizeof(PushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo 
+    {
+        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext                  = nullptr,
+        .flags                  = 0,
+        .setLayoutCount         = 1,
+        .pSetLayouts            = &m_descriptorSetLayout,  
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &pushConstantRange
+    };
+    
+    m_result = m_deviceFunctions->vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create pipeline layout (error code: %d)", m_result);
+        return false;
+    }
+
+    // The default variant compiles on the pipeline thread while the scene loads below, other variants are requested from mainLoop()
+    requestComputePipeline(getSettings().specialization);
+
+    /////////////////////////////////////////////////////////////////////
+    // Load the mesh from an OBJ file
+    /////////////////////////////////////////////////////////////////////
+
+    tinyobj::ObjReader reader;
+
+    if (!reader.ParseFromFile("../scenes/Sylveon.obj")) { // TODO: Better scene loading
+        qDebug() << "Failed to load .obj: " << reader.Error();
+    }
+
+    const std::vector<tinyobj::real_t>& objVertices = reader.GetAttrib().GetVertices(); // [x0, y0, z0, x1, y1, z1, ...]
+    const std::vector<tinyobj::real_t>& objUVs = reader.GetAttrib().texcoords; // [u, v, u, v, ...]
+    const std::vector<tinyobj::shape_t>& objShapes = reader.GetShapes(); // All shapes in the file
+
+    // Store indices from all shapes
+    std::vector<uint32_t> objIndices; // [v0, v1, v2, v0, v1, v2, ...]
+
+    for (const tinyobj::shape_t& objShape : objShapes) {
+        for (const tinyobj::index_t& index : objShape.mesh.indices) {
+            objIndices.push_back(index.vertex_index);
+        }
+    }
+
+    // Store material indices from all shapes
+    std::vector<uint32_t> matIndices; // [matIdx0, matIdx1, ...] (one per triangle)
+
+    for (const tinyobj::shape_t& shape : objShapes) 
+    {
+        for (int matId : shape.mesh.material_ids) 
+        {
+            matIndices.push_back(matId >= 0 ? static_cast<uint32_t>(matId) : 0);
+        }
+    }
+
+    // Handed to the renderer before the BVH is built, it rasterizes them until the path-traced image takes over
+    std::vector<float> previewVertices;
+    previewVertices.reserve(objIndices.size() * PREVIEW_VERTEX_FLOATS);
+
+    for (const tinyobj::shape_t& objShape : objShapes) 
+    {
+        const std::vector<tinyobj::index_t>& shapeIndices = objShape.mesh.indices;
+        for (size_t i = 0; i + 2 < shapeIndices.size(); i += 3) 
+        {
+            glm::vec3 positions[3];
+            for (int corner = 0; corner < 3; ++corner) 
+            {
+                size_t vertexIndex = size_t(shapeIndices[i + corner].vertex_index);
+                positions[corner] = glm::vec3(objVertices[3 * vertexIndex + 0], objVertices[3 * vertexIndex + 1], objVertices[3 * vertexIndex + 2]);
+            }
+
+            glm::vec3 normal = glm::cross(positions[1] - positions[0], positions[2] - positions[0]);
+            normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+
+            for (int corner = 0; corner < 3; ++corner) 
+            {
+                int uvIndex = shapeIndices[i + corner].texcoord_index;
+                float u = uvIndex >= 0 ? objUVs[2 * size_t(uvIndex) + 0] : 0.0f;
+                float v = uvIndex >= 0 ? objUVs[2 * size_t(uvIndex) + 1] : 0.0f;
+
+                previewVertices.insert(previewVertices.end(), { positions[corner].x, positions[corner].y, positions[corner].z,
+                                                                normal.x, normal.y, normal.z, u, v });
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_previewMutex);
+        m_previewVertices = std::move(previewVertices);
+    }
+
+    if (m_stopRequested) return false;
+
+    BVH bvh(objVertices, objIndices);
+
+    if (m_stopRequested) return false;
+
+    // Materials from the .mtl file, faces without one fall back to index 0
+    std::vector<MaterialData> materials;
+
+    for (const tinyobj::material_t& objMaterial : reader.GetMaterials()) 
+    {
+        MaterialData materialData;
+        materialData.diffuse    = glm::vec4(objMaterial.diffuse[0], objMaterial.diffuse[1], objMaterial.diffuse[2], 0.0f);
+        materialData.emission   = glm::vec4(objMaterial.emission[0], objMaterial.emission[1], objMaterial.emission[2], 0.0f);
+        materials.push_back(materialData);
+    }
+
+    if (materials.empty()) 
+    {
+        materials.push_back(MaterialData{ glm::vec4(0.8f, 0.8f, 0.8f, 0.0f), glm::vec4(0.0f) });
+    }
+
+    // The BVH reorders triangles, so per-triangle data has to follow the same order
+    const std::vector<uint32_t>& triangleIds = bvh.getTriangleIds();
+    std::vector<uint32_t> triangleMaterialIndices(triangleIds.size(), 0);
+
+    for (size_t triangleIndex = 0; triangleIndex < triangleIds.size(); ++triangleIndex) 
+    {
+        uint32_t objTriangleIndex = triangleIds[triangleIndex];
+        if (objTriangleIndex < matIndices.size() && matIndices[objTriangleIndex] < materials.size())
+            triangleMaterialIndices[triangleIndex] = matIndices[objTriangleIndex];
+    }
+
+    /////////////////////////////////////////////////////////////////////
+    // Buffer setup
+    /////////////////////////////////////////////////////////////////////
+
+    // Every upload is copied into the staging ring right away, the copies run while the rest of the scene is prepared
+    VulkanUploader uploader(m_vulkanWindow, m_computeQueueFamilyIndex, m_computeQueue);
+
+    // Setup vertex buffer
+    VkDeviceSize vertexSize = bvh.getVertices().size() * sizeof(tinyobj::real_t);
+    m_vertexBuffer          = VulkanBuffer(m_vulkanWindow, 
+                                            vertexSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_vertexBuffer.getBuffer(), bvh.getVertices().data(), vertexSize);
+
+    // Setup index buffer
+    VkDeviceSize indexSize  = bvh.getIndices().size() * sizeof(uint32_t);
+    m_indexBuffer           = VulkanBuffer(m_vulkanWindow, 
+                                            indexSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_indexBuffer.getBuffer(), bvh.getIndices().data(), indexSize);
+
+    // Setup BVH buffer
+    VkDeviceSize BVHSize    = bvh.getNodes().size() * sizeof(BVHNode);
+    m_BVHBuffer             = VulkanBuffer(m_vulkanWindow, 
+                                            BVHSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_BVHBuffer.getBuffer(), bvh.getNodes().data(), BVHSize);
+
+    // Every submit slot gets its own copy of the camera uniform, bound with a dynamic offset
+    const VkDeviceSize uniformBufferDeviceSize = UNIFORM_VECTOR_DATA_SIZE * UNIFORM_VECTOR_COUNT;
+    m_uniformAlignment      = uniAlign;
+    m_uniformRing           = VulkanRingBuffer(m_vulkanWindow, 
+                                            aligned(uniformBufferDeviceSize, uniAlign), 
+                                            BATCHES_IN_FLIGHT,
+                                            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+    // Prepare light data
+    std::vector<glm::vec3> positions = {
+        glm::vec3(0.0f, 2.0f, 0.0f),
+    };
+    std::vector<glm::vec3> normals = {
+        glm::vec3(0.0f, -1.0f, 0.0f),
+    };
+    std::vector<glm::vec3> intensities = {
+        glm::vec3(10.0f, 10.0f, 10.0f),
+    };
+    std::vector<glm::vec2> sizes = {
+        glm::vec2(2.5f, 2.5f),
+    };
+
+    Light lights(positions, normals, intensities, sizes);
+
+    lights.addEmissiveTriangles(bvh.getVertices(), bvh.getIndices(), triangleMaterialIndices, materials);
+    lights.buildAliasTable();
+
+    qDebug("Emitters: %u area lights, %zu emissive triangles", 
+           lights.getSamplerHeader().areaLightCount, lights.getEmissiveTriangles().size());
+
+    // Setup light buffer
+    VkDeviceSize lightSize  = lights.getLights().size() * sizeof(AreaLightData);
+    m_lightBuffer           = VulkanBuffer(m_vulkanWindow, 
+                                            lightSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_lightBuffer.getBuffer(), lights.getLights().data(), lightSize);
+
+    // Setup UV buffer
+    VkDeviceSize UVSize     = objUVs.size() * sizeof(tinyobj::real_t);
+    m_UVBuffer              = VulkanBuffer(m_vulkanWindow, 
+                                            UVSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_UVBuffer.getBuffer(), objUVs.data(), UVSize);
+
+    // Setup material index buffer
+    VkDeviceSize materialIndexSize  = triangleMaterialIndices.size() * sizeof(uint32_t);
+    m_materialIndexBuffer           = VulkanBuffer(m_vulkanWindow, 
+                                            materialIndexSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_materialIndexBuffer.getBuffer(), triangleMaterialIndices.data(), materialIndexSize);
+
+    // Setup emissive triangle buffer (never empty, a zero-sized buffer is not valid)
+    VkDeviceSize emissiveTriangleSize   = std::max<size_t>(lights.getEmissiveTriangles().size(), 1) * sizeof(EmissiveTriangleData);
+    m_emissiveTriangleBuffer            = VulkanBuffer(m_vulkanWindow, 
+                                            emissiveTriangleSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    if (!lights.getEmissiveTriangles().empty())
+        uploader.upload(m_emissiveTriangleBuffer.getBuffer(), lights.getEmissiveTriangles().data(), lights.getEmissiveTriangles().size() * sizeof(EmissiveTriangleData));
+
+    // Setup light sampler buffer (header followed by the alias table)
+    VkDeviceSize aliasTableSize     = lights.getAliasTable().size() * sizeof(AliasTableEntry);
+    VkDeviceSize lightSamplerSize   = sizeof(LightSamplerHeader) + std::max<VkDeviceSize>(aliasTableSize, sizeof(AliasTableEntry));
+    m_lightSamplerBuffer            = VulkanBuffer(m_vulkanWindow, 
+                                            lightSamplerSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_lightSamplerBuffer.getBuffer(), &lights.getSamplerHeader(), sizeof(LightSamplerHeader));
+    if (aliasTableSize > 0)
+        uploader.upload(m_lightSamplerBuffer.getBuffer(), lights.getAliasTable().data(), aliasTableSize, sizeof(LightSamplerHeader));
+
+    // Setup material buffer
+    VkDeviceSize materialSize   = materials.size() * sizeof(MaterialData);
+    m_materialBuffer            = VulkanBuffer(m_vulkanWindow, 
+                                            materialSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_materialBuffer.getBuffer(), materials.data(), materialSize);
+
+    /////////////////////////////////////////////////////////////////////
+    // Load the environment map and its sampling distribution
+    /////////////////////////////////////////////////////////////////////
+
+    if (m_stopRequested) return false;
+
+    std::string environmentPath;
+    {
+        std::lock_guard<std::mutex> lock(m_settingsMutex);
+        environmentPath = m_environmentPath;
+    }
+
+    // A missing or unreadable file still yields valid one-texel buffers, the shader skips the environment when its width is 0
+    EnvironmentMap environmentMap(environmentPath);
+    if (!environmentMap.isLoaded())
+        qWarning("Environment map %s could not be loaded, rendering without environment lighting", environmentPath.c_str());
+
+    if (m_stopRequested) return false;
+
+    // Setup environment texel buffer
+    VkDeviceSize environmentSize    = environmentMap.getTexels().size() * sizeof(glm::vec4);
+    m_environmentBuffer             = VulkanBuffer(m_vulkanWindow, 
+                                            environmentSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_environmentBuffer.getBuffer(), environmentMap.getTexels().data(), environmentSize);
+
+    // Setup environment distribution buffer (header followed by the marginal and conditional CDFs)
+    VkDeviceSize environmentCdfSize             = environmentMap.getDistribution().size() * sizeof(float);
+    VkDeviceSize environmentDistributionSize    = sizeof(EnvironmentHeader) + environmentCdfSize;
+    m_environmentDistributionBuffer             = VulkanBuffer(m_vulkanWindow, 
+                                                    environmentDistributionSize,
+                                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                    m_vulkanWindow->deviceLocalMemoryIndex());
+
+    uploader.upload(m_environmentDistributionBuffer.getBuffer(), &environmentMap.getHeader(), sizeof(EnvironmentHeader));
+    uploader.upload(m_environmentDistributionBuffer.getBuffer(), environmentMap.getDistribution().data(), environmentCdfSize, sizeof(EnvironmentHeader));
+
+    // Only written while coherence stats are compiled in, read by the host once the batches writing it have completed
+    m_coherenceStatsBuffer      = VulkanBuffer(m_vulkanWindow, 
+                                            COHERENCE_STATS_SIZE,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                            m_vulkanWindow->hostVisibleMemoryIndex());
+
+    const uint32_t zeroCoherenceStats[4] = {};
+    m_coherenceStatsBuffer.copyData(zeroCoherenceStats, COHERENCE_STATS_SIZE);
+    m_loggedCoherenceStats.fill(0);
+
+    /////////////////////////////////////////////////////////////////////
+    // Make the uploaded buffers visible to the compute queue
+    /////////////////////////////////////////////////////////////////////
+
+    uploader.finish();
+
+    {
+        VulkanCommandBuffer commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
+
+        commandBuffer.beginSingleTimeCommandBuffer();
+
+        uploader.recordAcquireBarriers(commandBuffer.getCommandBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        
+        commandBuffer.endSubmitAndWait();
+    }
+
+    /////////////////////////////////////////////////////////////////////
+    // Set up descriptor set
+    /////////////////////////////////////////////////////////////////////
+
+    VkDescriptorPoolSize descriptorPoolSizes[]
+    {
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = ACCUMULATION_IMAGE_COUNT + 1  // For the accumulation and triangle id images
+        },
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 15 // For vertex, UV, index, material index, BVH, light, emitter, light sampler, material, both environment, reservoir, surface feature, visibility and coherence stats buffers
+        },
+        {
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .descriptorCount = 1  // For camera data  
+        }
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .maxSets = 1,              // Still one descriptor set
+        .poolSizeCount = 3,
+        .pPoolSizes = descriptorPoolSizes
+    };
+
+    m_result = m_deviceFunctions->vkCreateDescriptorPool(m_device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create descriptor pool (error code: %d)", m_result);
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo 
+    {   
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .descriptorPool = m_descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &m_descriptorSetLayout
     };
 
-    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo 
-    {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
-        .bindingCount = 8,
-        .pBindings = descriptorSetLayoutBinding
-    };
-
-    m_result = m_deviceFunctions->vkCreateDescriptorSetLayout(m_device, &descriptorSetLayoutCreateInfo, nullptr, &m_descriptorSetLayout);
-    if (m_result != VK_SUCCESS)
-    {
-        qWarning("Failed to create descriptor set layout (error code: %d)", m_result);
-        return;
-    }
-
-    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo 
-    {   
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .descriptorPool = m_descriptorPool,
-        .descriptorSetCount = 1,
-        .pSetLayouts = &m_descriptorSetLayout
-    };
-
-    m_result = m_deviceFunctions->vkAllocateDescriptorSets(m_device, &descriptorSetAllocateInfo, &m_descriptorSet);
-    if (m_result != VK_SUCCESS)
-    {
-        qWarning("Failed to allocate descriptor set (error code: %d)", m_result);
-        return;
-    }
-    
-    VkDescriptorImageInfo descriptorImageInfo = {
-        .sampler = VK_NULL_HANDLE,
-        .imageView = m_storageImage.getImageView(),
-        .imageLayout = VK_IMAGE_LAYOUT_GENERAL
-    };
-
+    m_result = m_deviceFunctions->vkAllocateDescriptorSets(m_device, &descriptorSetAllocateInfo, &m_descriptorSet);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to allocate descriptor set (error code: %d)", m_result);
+        return false;
+    }
+    
     VkDescriptorBufferInfo vertexBufferInfo = {
         .buffer = m_vertexBuffer.getBuffer(),
         .offset = 0,
@@ -471,7 +835,7 @@ void VulkanRayTracer::initComputePipeline()
     };
 
     VkDescriptorBufferInfo uniformBufferInfo = {
-        .buffer = m_uniformBuffer.getBuffer(),
+        .buffer = m_uniformRing.getBuffer(),
         .offset = 0,
         .range = uniformBufferDeviceSize
     };
@@ -482,179 +846,820 @@ void VulkanRayTracer::initComputePipeline()
         .range = lightSize
     };
 
-    VkDescriptorBufferInfo UVBufferInfo = {
-        .buffer = m_UVBuffer.getBuffer(),
-        .offset = 0,
-        .range = UVSize
+    VkDescriptorBufferInfo UVBufferInfo = {
+        .buffer = m_UVBuffer.getBuffer(),
+        .offset = 0,
+        .range = UVSize
+    };
+
+    VkDescriptorBufferInfo materialIndexBufferInfo = {
+        .buffer = m_materialIndexBuffer.getBuffer(),
+        .offset = 0,
+        .range = materialIndexSize
+    };
+
+    VkDescriptorBufferInfo emissiveTriangleBufferInfo = {
+        .buffer = m_emissiveTriangleBuffer.getBuffer(),
+        .offset = 0,
+        .range = emissiveTriangleSize
+    };
+
+    VkDescriptorBufferInfo lightSamplerBufferInfo = {
+        .buffer = m_lightSamplerBuffer.getBuffer(),
+        .offset = 0,
+        .range = lightSamplerSize
+    };
+
+    VkDescriptorBufferInfo materialBufferInfo = {
+        .buffer = m_materialBuffer.getBuffer(),
+        .offset = 0,
+        .range = materialSize
+    };
+
+    VkDescriptorBufferInfo environmentBufferInfo = {
+        .buffer = m_environmentBuffer.getBuffer(),
+        .offset = 0,
+        .range = environmentSize
+    };
+
+    VkDescriptorBufferInfo environmentDistributionBufferInfo = {
+        .buffer = m_environmentDistributionBuffer.getBuffer(),
+        .offset = 0,
+        .range = environmentDistributionSize
+    };
+
+    VkWriteDescriptorSet vertexBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 1,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &vertexBufferInfo,
+        .pTexelBufferView = nullptr
+    };
+
+    VkWriteDescriptorSet indexBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 2,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &indexBufferInfo,
+        .pTexelBufferView = nullptr
+    };
+
+    VkWriteDescriptorSet BVHBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 3,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &BVHBufferInfo,
+        .pTexelBufferView = nullptr
+    };
+
+    VkWriteDescriptorSet uniformBufferWrite = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 4,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &uniformBufferInfo,
+        .pTexelBufferView = nullptr
+    };
+
+    VkWriteDescriptorSet lightBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 5,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &lightBufferInfo,
+        .pTexelBufferView = nullptr
+    };
+
+    VkWriteDescriptorSet UVBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 6,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &UVBufferInfo,
+        .pTexelBufferView = nullptr
+    };
+
+    VkWriteDescriptorSet materialIndexBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 7,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &materialIndexBufferInfo,
+        .pTexelBufferView = nullptr
     };
 
-    VkDescriptorBufferInfo materialIndexBufferInfo = {
-        .buffer = m_materialIndexBuffer.getBuffer(),
-        .offset = 0,
-        .range = materialIndexSize
+    VkWriteDescriptorSet emissiveTriangleBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 8,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &emissiveTriangleBufferInfo,
+        .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet storageImageWrite
+    VkWriteDescriptorSet lightSamplerBufferWrite
     {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 0,
+        .dstBinding = 9,
         .dstArrayElement = 0,
         .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-        .pImageInfo = &descriptorImageInfo,
-        .pBufferInfo = nullptr,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = &lightSamplerBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet vertexBufferWrite
+    VkWriteDescriptorSet materialBufferWrite
     {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 1,
+        .dstBinding = 10,
         .dstArrayElement = 0,
         .descriptorCount = 1,
         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pImageInfo = nullptr,
-        .pBufferInfo = &vertexBufferInfo,
+        .pBufferInfo = &materialBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet indexBufferWrite
+    VkWriteDescriptorSet environmentBufferWrite
     {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 2,
+        .dstBinding = 11,
         .dstArrayElement = 0,
         .descriptorCount = 1,
         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pImageInfo = nullptr,
-        .pBufferInfo = &indexBufferInfo,
+        .pBufferInfo = &environmentBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet BVHBufferWrite
+    VkWriteDescriptorSet environmentDistributionBufferWrite
     {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 3,
+        .dstBinding = 12,
         .dstArrayElement = 0,
         .descriptorCount = 1,
         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pImageInfo = nullptr,
-        .pBufferInfo = &BVHBufferInfo,
+        .pBufferInfo = &environmentDistributionBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet uniformBufferWrite = {
+    VkDescriptorBufferInfo coherenceStatsBufferInfo = {
+        .buffer = m_coherenceStatsBuffer.getBuffer(),
+        .offset = 0,
+        .range = COHERENCE_STATS_SIZE
+    };
+
+    VkWriteDescriptorSet coherenceStatsBufferWrite
+    {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 4,
+        .dstBinding = 17,
         .dstArrayElement = 0,
         .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pImageInfo = nullptr,
-        .pBufferInfo = &uniformBufferInfo,
+        .pBufferInfo = &coherenceStatsBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet lightBufferWrite
+    VkWriteDescriptorSet descriptorWrites[] = { 
+        vertexBufferWrite , 
+        indexBufferWrite , 
+        BVHBufferWrite , 
+        uniformBufferWrite , 
+        lightBufferWrite ,
+        UVBufferWrite ,
+        materialIndexBufferWrite ,
+        emissiveTriangleBufferWrite ,
+        lightSamplerBufferWrite ,
+        materialBufferWrite ,
+        environmentBufferWrite ,
+        environmentDistributionBufferWrite ,
+        coherenceStatsBufferWrite };
+    
+    m_deviceFunctions->vkUpdateDescriptorSets(m_device, sizeof(descriptorWrites) / sizeof(VkWriteDescriptorSet), descriptorWrites, 0, nullptr);
+
+    /////////////////////////////////////////////////////////////////////
+    // Create the resolution dependent resources
+    /////////////////////////////////////////////////////////////////////
+
+    if (!createRenderTargets(getRenderExtent()))
+        return false;
+
+    m_vulkanWindow->getMemoryAllocator().logStatistics();
+
+    return true;
+}
+
+VkExtent2D VulkanRayTracer::getRenderExtent()
+{
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+
+    // Traced at a fraction of the window and stretched over it by the renderer
+    float renderScale = std::clamp(m_settings.renderScale, 0.1f, 1.0f);
+    return VkExtent2D{
+        .width  = std::max(1u, uint32_t(float(m_swapChainSize.width())  * renderScale + 0.5f)),
+        .height = std::max(1u, uint32_t(float(m_swapChainSize.height()) * renderScale + 0.5f))
+    };
+}
+
+void VulkanRayTracer::setSwapChainSize(const QSize& swapChainSize)
+{
+    std::lock_guard<std::mutex> lock(m_settingsMutex);
+    m_swapChainSize = swapChainSize;
+}
+
+bool VulkanRayTracer::createRenderTargets(VkExtent2D renderExtent)
+{
+    m_renderExtent  = renderExtent;
+    m_tileColumns   = (renderExtent.width  + TILE_SIZE - 1) / TILE_SIZE;
+    m_tileRows      = (renderExtent.height + TILE_SIZE - 1) / TILE_SIZE;
+    m_tileCount     = m_tileColumns * m_tileRows;
+
+    // Written here and sampled by the renderer's graphics queue without a copy. Images are exclusive to one queue family
+    // at a time and handed over with release/acquire barrier pairs, see acquireDisplayImage()
+    for (VulkanImage& accumulationImage : m_accumulationImages) 
+        accumulationImage = VulkanImage(m_vulkanWindow, 
+                                        renderExtent.width, renderExtent.height, 
+                                        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                        m_vulkanWindow->deviceLocalMemoryIndex());
+
+    // Two reservoirs per pixel, each batch reads the half written by the previous one
+    VkDeviceSize reservoirSize  = 2 * VkDeviceSize(renderExtent.width) * renderExtent.height * RESERVOIR_SIZE;
+    m_reservoirBuffer           = VulkanBuffer(m_vulkanWindow, 
+                                        reservoirSize,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                        m_vulkanWindow->deviceLocalMemoryIndex());
+
+    // Camera hits per pixel of every accumulation image, read by reprojection and the denoiser and exported as AOVs
+    VkDeviceSize surfaceFeatureSize = ACCUMULATION_IMAGE_COUNT * VkDeviceSize(renderExtent.width) * renderExtent.height * SURFACE_FEATURE_SIZE;
+    m_surfaceFeatureBuffer          = VulkanBuffer(m_vulkanWindow, 
+                                        surfaceFeatureSize,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                        m_vulkanWindow->deviceLocalMemoryIndex());
+
+    for (const VulkanImage& accumulationImage : m_accumulationImages) 
+        if (accumulationImage.getImageView() == VK_NULL_HANDLE) 
+            return false;
+    if (m_reservoirBuffer.getBuffer() == VK_NULL_HANDLE || m_surfaceFeatureBuffer.getBuffer() == VK_NULL_HANDLE) 
+        return false;
+
+    VkDescriptorImageInfo descriptorImageInfo[ACCUMULATION_IMAGE_COUNT];
+    for (uint32_t i = 0; i < ACCUMULATION_IMAGE_COUNT; ++i) 
+    {
+        descriptorImageInfo[i] = {
+            .sampler = VK_NULL_HANDLE,
+            .imageView = m_accumulationImages[i].getImageView(),
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+        };
+    }
+
+    VkDescriptorBufferInfo reservoirBufferInfo = {
+        .buffer = m_reservoirBuffer.getBuffer(),
+        .offset = 0,
+        .range = reservoirSize
+    };
+
+    VkDescriptorBufferInfo surfaceFeatureBufferInfo = {
+        .buffer = m_surfaceFeatureBuffer.getBuffer(),
+        .offset = 0,
+        .range = surfaceFeatureSize
+    };
+
+    VkWriteDescriptorSet accumulationImageWrite
     {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 5,
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = ACCUMULATION_IMAGE_COUNT,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .pImageInfo = descriptorImageInfo,
+        .pBufferInfo = nullptr,
+        .pTexelBufferView = nullptr
+    };
+
+    VkWriteDescriptorSet reservoirBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 13,
         .dstArrayElement = 0,
         .descriptorCount = 1,
         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pImageInfo = nullptr,
-        .pBufferInfo = &lightBufferInfo,
+        .pBufferInfo = &reservoirBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet UVBufferWrite
+    VkWriteDescriptorSet surfaceFeatureBufferWrite
     {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 6,
+        .dstBinding = 14,
         .dstArrayElement = 0,
         .descriptorCount = 1,
         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pImageInfo = nullptr,
-        .pBufferInfo = &UVBufferInfo,
+        .pBufferInfo = &surfaceFeatureBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet materialIndexBufferWrite
+    VkWriteDescriptorSet descriptorWrites[] = { accumulationImageWrite, reservoirBufferWrite, surfaceFeatureBufferWrite };
+
+    // Only valid while no submit that uses the set is pending, see resizeRenderTargets()
+    m_deviceFunctions->vkUpdateDescriptorSets(m_device, sizeof(descriptorWrites) / sizeof(VkWriteDescriptorSet), descriptorWrites, 0, nullptr);
+
+    transitionToGeneral(m_accumulationImages);
+
+    if (!createAovTargets(m_aovMask) || !createVisibilityTargets(m_visibilityLayers)) 
+        return false;
+
+    qDebug("Tracing at %ux%u (%u tiles)", renderExtent.width, renderExtent.height, m_tileCount);
+
+    return true;
+}
+
+void VulkanRayTracer::transitionToGeneral(std::span<const VulkanImage> images)
+{
+    VulkanCommandBuffer commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
+
+    commandBuffer.beginSingleTimeCommandBuffer();
+
+    // Accumulation and denoised images stay in GENERAL, storage writes and sampling both accept it
+    std::vector<VkImageMemoryBarrier> imageMemoryBarriersToGeneral(images.size());
+    for (size_t i = 0; i < images.size(); ++i) 
+    {
+        imageMemoryBarriersToGeneral[i] = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = images[i].getImage(),
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        };
+    }
+
+    m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0,
+    0, nullptr,
+    0, nullptr, 
+    uint32_t(imageMemoryBarriersToGeneral.size()), imageMemoryBarriersToGeneral.data()); 
+
+    commandBuffer.endSubmitAndWait();
+}
+
+bool VulkanRayTracer::createAovTargets(uint32_t aovMask)
+{
+    // Written in place by every batch, so none may be pending while the image is replaced
+    waitForBatches();
+
+    // Albedo, normal and depth come from the surface features. The descriptor needs an image even when the triangle
+    // id is disabled, it is never written then
+    bool triangleIds    = (aovMask & AOV_TRIANGLE_ID) != 0;
+    m_triangleIdImage   = VulkanImage(m_vulkanWindow, 
+                                      triangleIds ? m_renderExtent.width : 1, triangleIds ? m_renderExtent.height : 1, 
+                                      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                      m_vulkanWindow->deviceLocalMemoryIndex());
+    if (m_triangleIdImage.getImageView() == VK_NULL_HANDLE) 
+        return false;
+
+    transitionToGeneral({ &m_triangleIdImage, 1 });
+
+    VkDescriptorImageInfo descriptorImageInfo = {
+        .sampler = VK_NULL_HANDLE,
+        .imageView = m_triangleIdImage.getImageView(),
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+    };
+
+    VkWriteDescriptorSet triangleIdImageWrite
     {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
         .dstSet = m_descriptorSet,
-        .dstBinding = 7,
+        .dstBinding = 15,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .pImageInfo = &descriptorImageInfo,
+        .pBufferInfo = nullptr,
+        .pTexelBufferView = nullptr
+    };
+
+    m_deviceFunctions->vkUpdateDescriptorSets(m_device, 1, &triangleIdImageWrite, 0, nullptr);
+    m_aovMask = aovMask;
+
+    return true;
+}
+
+bool VulkanRayTracer::exportAovs(const QString& directory)
+{
+    int32_t featureImage = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_displayMutex);
+        featureImage = m_writtenImage;
+    }
+
+    if (m_aovMask == 0 || featureImage < 0) 
+    {
+        qWarning("No AOVs to export, enable them in aovMask and let a full resolution batch finish");
+        return false;
+    }
+
+    // The copies read what the queued batches write
+    waitForBatches();
+
+    uint32_t width              = m_renderExtent.width;
+    uint32_t height             = m_renderExtent.height;
+    size_t pixelCount           = size_t(width) * height;
+    VkDeviceSize featureSize    = pixelCount * SURFACE_FEATURE_SIZE;
+    VkDeviceSize triangleIdSize = pixelCount * 4 * sizeof(float);
+    bool triangleIds            = (m_aovMask & AOV_TRIANGLE_ID) != 0;
+
+    VulkanBuffer stagingBuffer  = VulkanBuffer(m_vulkanWindow, 
+                                        featureSize + (triangleIds ? triangleIdSize : 0),
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        m_vulkanWindow->hostVisibleMemoryIndex());
+    if (stagingBuffer.getMappedData() == nullptr) 
+        return false;
+
+    VulkanCommandBuffer commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
+
+    commandBuffer.beginSingleTimeCommandBuffer();
+
+    VkMemoryBarrier transferMemoryBarrier
+    {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+    };
+
+    m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0,
+    1, &transferMemoryBarrier,
+    0, nullptr, 
+    0, nullptr);
+
+    VkBufferCopy featureCopy
+    {
+        .srcOffset  = VkDeviceSize(featureImage) * featureSize,
+        .dstOffset  = 0,
+        .size       = featureSize
+    };
+
+    m_deviceFunctions->vkCmdCopyBuffer(commandBuffer.getCommandBuffer(), m_surfaceFeatureBuffer.getBuffer(), stagingBuffer.getBuffer(), 1, &featureCopy);
+
+    if (triangleIds) 
+    {
+        VkBufferImageCopy triangleIdCopy
+        {
+            .bufferOffset       = featureSize,
+            .bufferRowLength    = 0,
+            .bufferImageHeight  = 0,
+            .imageSubresource   = {
+                .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel       = 0,
+                .baseArrayLayer = 0,
+                .layerCount     = 1
+            },
+            .imageOffset        = { 0, 0, 0 },
+            .imageExtent        = { width, height, 1 }
+        };
+
+        m_deviceFunctions->vkCmdCopyImageToBuffer(commandBuffer.getCommandBuffer(), m_triangleIdImage.getImage(), VK_IMAGE_LAYOUT_GENERAL, 
+                                                  stagingBuffer.getBuffer(), 1, &triangleIdCopy);
+    }
+
+    VkMemoryBarrier hostMemoryBarrier
+    {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT
+    };
+
+    m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_HOST_BIT,
+    0,
+    1, &hostMemoryBarrier,
+    0, nullptr, 
+    0, nullptr);
+
+    commandBuffer.endSubmitAndWait();
+
+    // SurfaceFeature is two vec4: mean normal and depth, then mean albedo and the latest hit distance
+    const float* features = static_cast<const float*>(stagingBuffer.getMappedData());
+    auto featureChannels = [&](uint32_t first, uint32_t count) {
+        std::vector<float> values(pixelCount * count);
+        for (size_t i = 0; i < pixelCount; ++i) 
+            for (uint32_t c = 0; c < count; ++c) 
+                values[i * count + c] = features[i * 8 + first + c];
+        return values;
+    };
+
+    QDir().mkpath(directory);
+    QDir outputDirectory(directory);
+    bool written = true;
+
+    if (m_aovMask & AOV_ALBEDO) 
+        written &= writePfm(outputDirectory.filePath(QStringLiteral("albedo.pfm")), width, height, 3, featureChannels(4, 3));
+    if (m_aovMask & AOV_NORMAL) 
+        written &= writePfm(outputDirectory.filePath(QStringLiteral("normal.pfm")), width, height, 3, featureChannels(0, 3));
+    if (m_aovMask & AOV_DEPTH) 
+        written &= writePfm(outputDirectory.filePath(QStringLiteral("depth.pfm")), width, height, 1, featureChannels(3, 1));
+
+    if (triangleIds) 
+    {
+        // Alpha is always 1, red and green hold the id halves
+        const float* texels = features + pixelCount * 8;
+        std::vector<float> values(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; ++i) 
+            for (uint32_t c = 0; c < 3; ++c) 
+                values[i * 3 + c] = texels[i * 4 + c];
+        written &= writePfm(outputDirectory.filePath(QStringLiteral("triangle_id.pfm")), width, height, 3, values);
+    }
+
+    if (written) 
+        qDebug("Exported AOVs (mask 0x%x) to %s", m_aovMask, qPrintable(directory));
+    return written;
+}
+
+bool VulkanRayTracer::createVisibilityTargets(uint32_t visibilityLayers)
+{
+    // Written by the first batches after a restart and read by all later ones
+    waitForBatches();
+
+    VkDeviceSize visibilitySize = visibilityLayers > 0 
+                                ? visibilityLayers * VkDeviceSize(m_renderExtent.width) * m_renderExtent.height * VISIBILITY_ENTRY_SIZE 
+                                : VISIBILITY_ENTRY_SIZE;
+    m_visibilityBuffer          = VulkanBuffer(m_vulkanWindow, 
+                                        visibilitySize,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                        m_vulkanWindow->deviceLocalMemoryIndex());
+    if (m_visibilityBuffer.getBuffer() == VK_NULL_HANDLE) 
+        return false;
+
+    VkDescriptorBufferInfo visibilityBufferInfo = {
+        .buffer = m_visibilityBuffer.getBuffer(),
+        .offset = 0,
+        .range = visibilitySize
+    };
+
+    VkWriteDescriptorSet visibilityBufferWrite
+    {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = m_descriptorSet,
+        .dstBinding = 16,
         .dstArrayElement = 0,
         .descriptorCount = 1,
         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
         .pImageInfo = nullptr,
-        .pBufferInfo = &materialIndexBufferInfo,
+        .pBufferInfo = &visibilityBufferInfo,
         .pTexelBufferView = nullptr
     };
 
-    VkWriteDescriptorSet descriptorWrites[] = { 
-        storageImageWrite , 
-        vertexBufferWrite , 
-        indexBufferWrite , 
-        BVHBufferWrite , 
-        uniformBufferWrite , 
-        lightBufferWrite ,
-        UVBufferWrite ,
-        materialIndexBufferWrite };
-    
-    m_deviceFunctions->vkUpdateDescriptorSets(m_device, 8, descriptorWrites, 0, nullptr);
+    m_deviceFunctions->vkUpdateDescriptorSets(m_device, 1, &visibilityBufferWrite, 0, nullptr);
+    m_visibilityLayers = visibilityLayers;
+
+    return true;
+}
+
+bool VulkanRayTracer::createDenoiseTargets()
+{
+    // The denoiser's descriptor set is rewritten below
+    waitForBatches();
+
+    // Sampled by the renderer in place of the accumulation image with the same index
+    for (VulkanImage& denoisedImage : m_denoisedImages) 
+        denoisedImage = VulkanImage(m_vulkanWindow, 
+                                    m_renderExtent.width, m_renderExtent.height, 
+                                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                    m_vulkanWindow->deviceLocalMemoryIndex());
+
+    for (const VulkanImage& denoisedImage : m_denoisedImages) 
+        if (denoisedImage.getImageView() == VK_NULL_HANDLE) 
+            return false;
+
+    transitionToGeneral(m_denoisedImages);
+
+    std::array<VkImageView, ACCUMULATION_IMAGE_COUNT> inputViews{};
+    std::array<VkImageView, ACCUMULATION_IMAGE_COUNT> outputViews{};
+    for (uint32_t i = 0; i < ACCUMULATION_IMAGE_COUNT; ++i) 
+    {
+        inputViews[i]   = m_accumulationImages[i].getImageView();
+        outputViews[i]  = m_denoisedImages[i].getImageView();
+    }
+
+    VkDeviceSize surfaceFeatureSize = ACCUMULATION_IMAGE_COUNT * VkDeviceSize(m_renderExtent.width) * m_renderExtent.height * SURFACE_FEATURE_SIZE;
+    return m_denoiser.setTargets(m_renderExtent, inputViews, outputViews, m_surfaceFeatureBuffer.getBuffer(), surfaceFeatureSize);
+}
+
+bool VulkanRayTracer::resizeRenderTargets(VkExtent2D renderExtent)
+{
+    // Every queued batch uses the descriptor set and the images about to be replaced
+    waitForBatches();
+
+    {
+        std::lock_guard<std::mutex> lock(m_displayMutex);
+
+        // Frames in flight may still sample the old images. They are destroyed once every frame recorded
+        // until now has completed, the renderer shows its placeholder until the first batch at the new size
+        for (uint32_t i = 0; i < ACCUMULATION_IMAGE_COUNT; ++i) 
+        {
+            m_retiredImages[i] = std::move(m_accumulationImages[i]);
+            m_retiredImages[ACCUMULATION_IMAGE_COUNT + i] = std::move(m_denoisedImages[i]);
+        }
+        m_hasRetiredImages = true;
+        m_retiredImagesFrame = m_displayFrame + uint64_t(m_vulkanWindow->concurrentFrameCount()) + 1;
+
+        m_latestImage       = -1;
+        m_displayedImage    = -1;
+        m_writtenImage      = -1;
+        m_imageOwners.fill(ImageOwner::Compute);
+        m_imageRetireFrames.fill(0);
+        m_publishedDenoised.fill(false);
+    }
+
+    // Denoised images follow lazily, see mainLoop()
+    m_denoiser.releaseTargets();
+
+    return createRenderTargets(renderExtent);
+}
+
+bool VulkanRayTracer::hasRetiredImages()
+{
+    std::lock_guard<std::mutex> lock(m_displayMutex);
+    return m_hasRetiredImages;
+}
+
+void VulkanRayTracer::destroyRetiredImages(bool force)
+{
+    std::lock_guard<std::mutex> lock(m_displayMutex);
+
+    if (!m_hasRetiredImages || (!force && m_displayFrame < m_retiredImagesFrame)) 
+        return;
+
+    for (VulkanImage& retiredImage : m_retiredImages) 
+        retiredImage.destroy();
+    m_hasRetiredImages = false;
+}
+
+void VulkanRayTracer::requestComputePipeline(const RayTracerSpecialization& specialization)
+{
+    if (m_computePipelines.count(specialization) || m_pendingPipelines.count(specialization)) 
+        return;
+
+    // Only reads the shader module, the layout and the pipeline cache, which Vulkan synchronizes internally
+    VkShaderModule shaderModule = specialization.coherenceStats ? m_statsShaderModule : m_computeShaderModule;
+    m_pendingPipelines.emplace(specialization, std::async(std::launch::async, [this, specialization, shaderModule]() {
+        return compileComputePipeline(specialization, shaderModule);
+    }));
+}
+
+VkPipeline VulkanRayTracer::getComputePipeline(const RayTracerSpecialization& specialization, bool& failed)
+{
+    failed = m_failedPipelines.count(specialization) > 0;
+    if (failed) 
+        return VK_NULL_HANDLE;
+
+    auto cachedPipeline = m_computePipelines.find(specialization);
+    if (cachedPipeline != m_computePipelines.end())
+        return cachedPipeline->second;
+
+    requestComputePipeline(specialization);
 
-    /////////////////////////////////////////////////////////////////////
-    // Compute pipeline setup
-    /////////////////////////////////////////////////////////////////////
+    auto pendingPipeline = m_pendingPipelines.find(specialization);
+    if (pendingPipeline->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) 
+        return VK_NULL_HANDLE;
 
-    VkShaderModule computeShaderModule = m_vulkanWindow->createShaderModule(QStringLiteral(":/raytrace_comp.spv"));
+    VkPipeline computePipeline = pendingPipeline->second.get();
+    m_pendingPipelines.erase(pendingPipeline);
 
-    VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo 
+    if (computePipeline == VK_NULL_HANDLE) 
     {
-        .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .pNext               = nullptr,
-        .flags               = 0,                
-        .stage               = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module              = computeShaderModule,
-        .pName               = "main",
-        .pSpecializationInfo = nullptr            
+        qWarning("Compute pipeline variant could not be created, it is not retried until the shader is reloaded");
+        m_failedPipelines.insert(specialization);
+        failed = true;
+        return VK_NULL_HANDLE;
+    }
+
+    m_computePipelines.emplace(specialization, computePipeline);
+    return computePipeline;
+}
+
+VkPipeline VulkanRayTracer::compileComputePipeline(const RayTracerSpecialization& specialization, VkShaderModule shaderModule)
+{
+    QElapsedTimer compileTimer;
+    compileTimer.start();
+
+    // constant_id values must match the declarations at the top of raytrace_comp.comp
+    VkSpecializationMapEntry specializationMapEntries[] = {
+        { .constantID = 0, .offset = offsetof(RayTracerSpecialization, workgroupWidth),   .size = sizeof(uint32_t) },
+        { .constantID = 1, .offset = offsetof(RayTracerSpecialization, workgroupHeight),  .size = sizeof(uint32_t) },
+        { .constantID = 2, .offset = offsetof(RayTracerSpecialization, maxDepth),         .size = sizeof(int32_t) },
+        { .constantID = 3, .offset = offsetof(RayTracerSpecialization, sssMaxBounces),    .size = sizeof(int32_t) },
+        { .constantID = 4, .offset = offsetof(RayTracerSpecialization, rouletteMinDepth), .size = sizeof(int32_t) },
+        { .constantID = 5, .offset = offsetof(RayTracerSpecialization, restirCandidates), .size = sizeof(int32_t) },
+        { .constantID = 6, .offset = offsetof(RayTracerSpecialization, restirNeighbours), .size = sizeof(int32_t) },
+        { .constantID = 7, .offset = offsetof(RayTracerSpecialization, aovMask),          .size = sizeof(uint32_t) },
+        { .constantID = 8, .offset = offsetof(RayTracerSpecialization, sortSecondaryRays), .size = sizeof(VkBool32) },
+        { .constantID = 9, .offset = offsetof(RayTracerSpecialization, coherenceStats),   .size = sizeof(VkBool32) },
     };
 
-    VkPushConstantRange pushConstantRange
+    if (specialization.sortSecondaryRays && specialization.workgroupWidth * specialization.workgroupHeight > MAX_SORTED_RAYS) 
+        qWarning("Workgroups of more than %u invocations cannot sort rays, they are traced unsorted", MAX_SORTED_RAYS);
+
+    VkSpecializationInfo specializationInfo
     {
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .offset     = 0,                              
-        .size       = sizeof(PushConstants)
+        .mapEntryCount = sizeof(specializationMapEntries) / sizeof(VkSpecializationMapEntry),
+        .pMapEntries   = specializationMapEntries,
+        .dataSize      = sizeof(RayTracerSpecialization),
+        .pData         = &specialization
     };
 
-    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo 
+    VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo 
     {
-        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .pNext                  = nullptr,
-        .flags                  = 0,
-        .setLayoutCount         = 1,
-        .pSetLayouts            = &m_descriptorSetLayout,  
-        .pushConstantRangeCount = 1,
-        .pPushConstantRanges    = &pushConstantRange
+        .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .pNext               = nullptr,
+        .flags               = 0,                
+        .stage               = VK_SHADER_STAGE_COMPUTE_BIT,
+        .module              = shaderModule,
+        .pName               = "main",
+        .pSpecializationInfo = &specializationInfo            
     };
-    
-    m_result = m_deviceFunctions->vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
-    if (m_result != VK_SUCCESS)
-        qDebug("Failed to create pipeline layout: %d", m_result);
 
     VkComputePipelineCreateInfo computePipelineCreateInfo 
     {
@@ -667,65 +1672,411 @@ void VulkanRayTracer::initComputePipeline()
         .basePipelineIndex  = -1
     };
 
-    m_result = m_deviceFunctions->vkCreateComputePipelines(m_device, m_pipelineCache, 1, &computePipelineCreateInfo, VK_NULL_HANDLE, &m_computePipeline);
-    if (m_result != VK_SUCCESS)
-        qDebug("Failed to create compute pipeline: %d", m_result);
+    // Runs on the pipeline thread, so the result stays local instead of going through m_result
+    VkPipeline computePipeline = VK_NULL_HANDLE;
+    VkResult result = m_deviceFunctions->vkCreateComputePipelines(m_device, m_pipelineCache.getPipelineCache(), 1, &computePipelineCreateInfo, VK_NULL_HANDLE, &computePipeline);
+    if (result != VK_SUCCESS)
+    {
+        qWarning("Failed to create compute pipeline (error code: %d)", result);
+        return VK_NULL_HANDLE;
+    }
+
+    qDebug("Compiled compute pipeline variant in %lld ms (workgroup %ux%u, max depth %d, SSS bounces %d, roulette after %d, ReSTIR %d candidates / %d neighbours, AOV mask 0x%x, ray sorting %s, coherence stats %s)",
+           compileTimer.elapsed(),
+           specialization.workgroupWidth, specialization.workgroupHeight,
+           specialization.maxDepth, specialization.sssMaxBounces, specialization.rouletteMinDepth,
+           specialization.restirCandidates, specialization.restirNeighbours, specialization.aovMask,
+           specialization.sortSecondaryRays ? "on" : "off", specialization.coherenceStats ? "on" : "off");
 
+    return computePipeline;
+}
+
+void VulkanRayTracer::destroyComputePipelines()
+{
+    // Compiles still running use the shader module, it has to outlive them
+    for (auto& [specialization, pendingPipeline] : m_pendingPipelines) 
     {
-        VulkanCommandBuffer commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
+        VkPipeline computePipeline = pendingPipeline.get();
+        if (computePipeline) 
+            m_deviceFunctions->vkDestroyPipeline(m_device, computePipeline, nullptr);
+    }
+    m_pendingPipelines.clear();
 
-        commandBuffer.beginSingleTimeCommandBuffer();
+    for (auto& [specialization, computePipeline] : m_computePipelines) 
+        m_deviceFunctions->vkDestroyPipeline(m_device, computePipeline, nullptr);
+    m_computePipelines.clear();
+    m_failedPipelines.clear();
+}
+
+void VulkanRayTracer::reloadComputeShader(const QString& shaderName, const QString& spirvPath)
+{
+    std::lock_guard<std::mutex> lock(m_shaderMutex);
+    if (shaderName == QStringLiteral("raytrace_stats_comp"))
+        m_statsShaderPath = spirvPath;
+    else
+        m_computeShaderPath = spirvPath;
+    m_shaderReloadRequested = true;
+}
+
+bool VulkanRayTracer::createShaderModules(VkShaderModule& computeShaderModule, VkShaderModule& statsShaderModule)
+{
+    std::lock_guard<std::mutex> lock(m_shaderMutex);
+
+    // Both are overwritten even on failure, so the caller never keeps a handle it already destroyed
+    computeShaderModule = VK_NULL_HANDLE;
+    statsShaderModule   = VK_NULL_HANDLE;
+
+    computeShaderModule = m_vulkanWindow->createShaderModule(m_computeShaderPath);
+    if (computeShaderModule == VK_NULL_HANDLE) 
+        return false;
+
+    // Declares the subgroup capabilities, so it may only be created where they are supported. Without it the
+    // coherence stats stay off
+    if (m_subgroupStatsSupported)
+        statsShaderModule = m_vulkanWindow->createShaderModule(m_statsShaderPath);
+    return true;
+}
 
-        VkImageMemoryBarrier imageMemoryBarrierToTransferSrc
+bool VulkanRayTracer::querySubgroupStatsSupport()
+{
+    VkPhysicalDeviceSubgroupProperties subgroupProperties
+    {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+        .pNext = nullptr
+    };
+
+    VkPhysicalDeviceProperties2 properties2
+    {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &subgroupProperties
+    };
+
+    m_vulkanWindow->vulkanInstance()->functions()->vkGetPhysicalDeviceProperties2(m_vulkanWindow->physicalDevice(), &properties2);
+
+    // Everything raytrace_stats_comp uses, in compute shaders
+    const VkSubgroupFeatureFlags requiredOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT | 
+                                                      VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_SHUFFLE_BIT;
+
+    bool supported = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) && 
+                     (subgroupProperties.supportedOperations & requiredOperations) == requiredOperations;
+    if (!supported)
+        qWarning("Subgroup ballot, shuffle and arithmetic are not supported in compute shaders, coherence stats are disabled");
+    return supported;
+}
+
+bool VulkanRayTracer::swapReloadedComputeShader(const RayTracerSpecialization& specialization)
+{
+    // A newer file replaces a reload that is still compiling
+    if (m_shaderReloadRequested.exchange(false)) 
+    {
+        if (m_reloadPipeline.valid()) 
         {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .pNext = nullptr,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = m_storageImage.getImage(),
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1
+            VkPipeline stalePipeline = m_reloadPipeline.get();
+            if (stalePipeline) 
+                m_deviceFunctions->vkDestroyPipeline(m_device, stalePipeline, nullptr);
+        }
+        for (VkShaderModule* shaderModule : { &m_reloadShaderModule, &m_reloadStatsShaderModule }) 
+        {
+            if (*shaderModule) 
+                m_deviceFunctions->vkDestroyShaderModule(m_device, *shaderModule, nullptr);
+            *shaderModule = VK_NULL_HANDLE;
+        }
+
+        if (!createShaderModules(m_reloadShaderModule, m_reloadStatsShaderModule)) 
+            return false;
+
+        // The running variant is rebuilt from whichever of the two builds it uses
+        VkShaderModule shaderModule = specialization.coherenceStats ? m_reloadStatsShaderModule : m_reloadShaderModule;
+        if (shaderModule == VK_NULL_HANDLE) 
+            return false;
+
+        m_reloadSpecialization = specialization;
+        m_reloadPipeline = std::async(std::launch::async, [this, specialization, shaderModule]() {
+            return compileComputePipeline(specialization, shaderModule);
+        });
+    }
+
+    if (!m_reloadPipeline.valid() || m_reloadPipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready) 
+        return false;
+
+    VkPipeline reloadPipeline = m_reloadPipeline.get();
+    if (reloadPipeline == VK_NULL_HANDLE) 
+    {
+        qWarning("Keeping the running compute shader");
+        for (VkShaderModule* shaderModule : { &m_reloadShaderModule, &m_reloadStatsShaderModule }) 
+        {
+            if (*shaderModule) 
+                m_deviceFunctions->vkDestroyShaderModule(m_device, *shaderModule, nullptr);
+            *shaderModule = VK_NULL_HANDLE;
+        }
+        return false;
+    }
+
+    // Submits still queued were recorded with the old pipelines
+    waitForBatches();
+    destroyComputePipelines();
+
+    m_deviceFunctions->vkDestroyShaderModule(m_device, m_computeShaderModule, nullptr);
+    m_computeShaderModule = std::exchange(m_reloadShaderModule, VK_NULL_HANDLE);
+
+    if (m_statsShaderModule) 
+        m_deviceFunctions->vkDestroyShaderModule(m_device, m_statsShaderModule, nullptr);
+    m_statsShaderModule = std::exchange(m_reloadStatsShaderModule, VK_NULL_HANDLE);
+
+    m_computePipelines.emplace(m_reloadSpecialization, reloadPipeline);
+
+    qDebug("Swapped in the reloaded compute shader");
+    return true;
+}
+
+void VulkanRayTracer::waitForBatches()
+{
+    m_batchTimeline.wait(m_batchTimelineValue);
+}
+
+void VulkanRayTracer::updateTilesPerSubmit(uint32_t slot)
+{
+    // The slot's previous submit has completed, its timestamps are available unless no tiles were recorded
+    if (m_slotTileCounts[slot] == 0) 
+        return;
+
+    uint64_t timestamps[2] = {};
+    if (m_timestampQueries.getResults(2 * slot, 2, timestamps) && timestamps[1] > timestamps[0]) 
+    {
+        // Preview tiles trace one pixel in stride^2, scaled back to the cost of a full tile
+        double strideArea = double(m_slotPixelStrides[slot] * m_slotPixelStrides[slot]);
+        double tileTimeNs = double(timestamps[1] - timestamps[0]) * double(m_timestampPeriod) * strideArea / double(m_slotTileCounts[slot]);
+
+        // Smoothed so one slow submit does not collapse the tile count
+        m_tileTimeNs = m_tileTimeNs > 0.0 ? 0.75 * m_tileTimeNs + 0.25 * tileTimeNs : tileTimeNs;
+        m_tilesPerSubmit = uint32_t(std::clamp(SUBMIT_BUDGET_NS / m_tileTimeNs, 1.0, double(m_tileCount)));
+    }
+
+    m_slotTileCounts[slot] = 0;
+}
+
+void VulkanRayTracer::logCoherenceStats(uint64_t batchValue)
+{
+    if (m_coherenceStatsBuffer.getMappedData() == nullptr) 
+        return;
+
+    if (!m_coherenceStatsTimer.isValid()) 
+        m_coherenceStatsTimer.start();
+    if (m_coherenceStatsTimer.elapsed() < 1000) 
+        return;
+    m_coherenceStatsTimer.restart();
+
+    // The counters are atomics shared by every batch, so the ring is drained first. Reading while batches are in flight
+    // would catch some of their counts. Only stats builds pay for the stall, once per second
+    m_batchTimeline.wait(batchValue);
+
+    const volatile uint32_t* counters = static_cast<const volatile uint32_t*>(m_coherenceStatsBuffer.getMappedData());
+    std::array<uint32_t, 3> stats = { counters[0], counters[1], counters[2] };
+
+    // Unsigned differences stay right when a counter wraps
+    uint32_t subgroupTraces = stats[0] - m_loggedCoherenceStats[0];
+    uint32_t rays           = stats[1] - m_loggedCoherenceStats[1];
+    uint32_t uniqueNodes    = stats[2] - m_loggedCoherenceStats[2];
+    m_loggedCoherenceStats  = stats;
+
+    if (subgroupTraces == 0 || rays == 0) 
+        return;
+
+    // Lower is more coherent, a subgroup whose rays all fetch the same nodes costs as much as one ray
+    qDebug("Bounce rays: %.1f distinct BVH nodes fetched per subgroup, %.1f per ray (%u rays)",
+           double(uniqueNodes) / double(subgroupTraces), double(uniqueNodes) / double(rays), rays);
+}
+
+uint32_t VulkanRayTracer::acquireAccumulationImage(uint32_t& historyImage, bool& acquireOwnership)
+{
+    while (!m_stopRequested) 
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_displayMutex);
+
+            for (uint32_t i = 0; i < ACCUMULATION_IMAGE_COUNT; ++i) 
+            {
+                // Published and displayed images belong to the graphics side until it hands them back
+                bool isOwned        = m_imageOwners[i] == ImageOwner::Compute;
+                bool isReturned     = m_imageOwners[i] == ImageOwner::ReleasedToCompute && m_displayFrame >= m_imageRetireFrames[i];
+                bool isHistory      = int32_t(i) == m_writtenImage;
+
+                if ((isOwned || isReturned) && !isHistory) 
+                {
+                    historyImage = m_writtenImage >= 0 ? uint32_t(m_writtenImage) : i;
+                    acquireOwnership = isReturned;
+                    m_imageOwners[i] = ImageOwner::Compute;
+                    return i;
+                }
             }
-        };  
+        }
 
-        m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0, nullptr,
-        0, nullptr, 
-        1, &imageMemoryBarrierToTransferSrc); 
+        QThread::msleep(1);
+    }
 
-        commandBuffer.endSubmitAndWait();
+    return UINT32_MAX;
+}
+
+bool VulkanRayTracer::isPublishedImageConsumed()
+{
+    std::lock_guard<std::mutex> lock(m_displayMutex);
+    return m_latestImage < 0 || m_latestImage == m_displayedImage;
+}
+
+void VulkanRayTracer::publishAccumulationImage(uint32_t imageIndex, uint64_t batchValue)
+{
+    std::lock_guard<std::mutex> lock(m_displayMutex);
+    m_latestImage       = int32_t(imageIndex);
+    m_latestBatchValue  = batchValue;
+    m_imageOwners[imageIndex] = ImageOwner::ReleasedToGraphics;
+}
+
+const VulkanImage& VulkanRayTracer::getPublishedImage(uint32_t imageIndex) const
+{
+    return m_publishedDenoised[imageIndex] ? m_denoisedImages[imageIndex] : m_accumulationImages[imageIndex];
+}
+
+VkImageMemoryBarrier VulkanRayTracer::ownershipBarrier(uint32_t imageIndex, bool toGraphics, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) const
+{
+    // Release and acquire must name the same families and layouts, the images never leave GENERAL. With one family
+    // for both queues this is a plain barrier
+    return {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = srcAccessMask,
+        .dstAccessMask = dstAccessMask,
+        .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = toGraphics ? m_computeQueueFamilyIndex : m_graphicsQueueFamilyIndex,
+        .dstQueueFamilyIndex = toGraphics ? m_graphicsQueueFamilyIndex : m_computeQueueFamilyIndex,
+        .image = getPublishedImage(imageIndex).getImage(),
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+}
+
+VkImageView VulkanRayTracer::acquireDisplayImage(uint64_t frame, VkCommandBuffer commandBuffer)
+{
+    std::lock_guard<std::mutex> lock(m_displayMutex);
+    m_displayFrame = frame;
+
+    // Switch only once the batch has finished, the frames still in flight keep sampling the old image
+    if (m_latestImage >= 0 && m_latestImage != m_displayedImage && m_batchTimeline.getCompletedValue() >= m_latestBatchValue) 
+    {
+        uint64_t retireFrame = frame + uint64_t(m_vulkanWindow->concurrentFrameCount());
+
+        // The new image is acquired. The old one goes back to compute, and so does anything published in between
+        // that was never shown: a release without its acquire would leave that image stuck with the graphics family
+        std::vector<VkImageMemoryBarrier> acquireBarriers{};
+        std::vector<VkImageMemoryBarrier> releaseBarriers{};
+
+        for (uint32_t i = 0; i < ACCUMULATION_IMAGE_COUNT; ++i) 
+        {
+            bool isLatest = int32_t(i) == m_latestImage;
+
+            if (m_imageOwners[i] == ImageOwner::ReleasedToGraphics) 
+            {
+                acquireBarriers.push_back(ownershipBarrier(i, true, 0, VK_ACCESS_SHADER_READ_BIT));
+                m_imageOwners[i] = ImageOwner::Graphics;
+            }
+
+            if (!isLatest && m_imageOwners[i] == ImageOwner::Graphics) 
+            {
+                releaseBarriers.push_back(ownershipBarrier(i, false, 0, 0));
+                m_imageOwners[i] = ImageOwner::ReleasedToCompute;
+                m_imageRetireFrames[i] = retireFrame;
+            }
+        }
+
+        // Queues of one family share ownership. The timeline check above ordered the batch before this frame, the
+        // barrier makes the compute writes visible to the fragment shader
+        if (m_computeQueueFamilyIndex == m_graphicsQueueFamilyIndex) 
+        {
+            VkImageMemoryBarrier visibilityBarrier = ownershipBarrier(uint32_t(m_latestImage), true, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+            m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr, 
+            1, &visibilityBarrier);
+        }
+        else 
+        {
+            m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr, 
+            uint32_t(acquireBarriers.size()), acquireBarriers.data());
+
+            // Frames submitted earlier on this queue finish sampling the released images first
+            if (!releaseBarriers.empty()) 
+                m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0,
+                0, nullptr,
+                0, nullptr, 
+                uint32_t(releaseBarriers.size()), releaseBarriers.data());
+        }
+
+        m_displayedImage = m_latestImage;
+        m_presentationScheduler.onPresented();
     }
 
-    /////////////////////////////////////////////////////////////////////
-    // Main loop call
-    /////////////////////////////////////////////////////////////////////
+    // Caught up with everything published, ask for the next batch
+    if (m_displayedImage == m_latestImage) 
+        m_presentationScheduler.requestPresent();
 
-    mainLoop();
+    return m_displayedImage >= 0 ? getPublishedImage(uint32_t(m_displayedImage)).getImageView() : VK_NULL_HANDLE;
 }
 
 void VulkanRayTracer::mainLoop()
 {
     const uint32_t NUM_SAMPLE_BATCHES = 1024; // TODO: Pass max samples through UI
 
-    bool shouldRayTrace     = true;
-    uint32_t sampleBatch    = 0;
+    bool shouldRayTrace         = true;
+    uint32_t sampleBatch        = 0;
+    int32_t pendingPublishImage = -1; // Written by the previous batch, handed to the renderer by the next one
+
+    // A batch is split over several submits, these carry it from one loop iteration to the next
+    uint32_t nextTile           = 0;
+    uint32_t outputImage        = 0;
+    uint32_t historyImage       = 0;
+    bool acquireOwnership       = false;
+
+    std::array<QVector4D, UNIFORM_VECTOR_COUNT> cameraUniform{}; // std140 layout of CameraBuffer in raytrace_comp.comp
+    static_assert(sizeof(cameraUniform) == UNIFORM_VECTOR_DATA_SIZE * UNIFORM_VECTOR_COUNT);
+
+    // A camera change reprojects the previous image instead of discarding it. Each image remembers the camera it was
+    // traced from, the history is only usable while compute still owns it and nothing else about the samples changed
+    std::array<std::array<QVector4D, 4>, ACCUMULATION_IMAGE_COUNT> imageCameras{};
+    bool historyValid           = false;
+    uint32_t historyMode        = HISTORY_NONE;
+    // While the camera moves, batches are traced at a pixel stride and never accumulate. Full resolution
+    // accumulation restarts once the camera has been still for previewSettleMs
+    QElapsedTimer stillTimer{};
+    bool cameraMoving           = false;
+    bool previewBatch           = false;
+    uint32_t pixelStride        = 1;
+
     QVector3D lastCameraPosition{};
     QVector3D lastCameraDirection{};
     QVector3D lastCameraUp{};
-    float lastCameraFov     = -1.0f;
+    float lastCameraFov         = -1.0f;
+    RayTracerSettings lastSettings{};
+
+    m_rayTraceTimer.start();
 
-    while(true)
+    while (!m_stopRequested)
     {
         Camera *camera = m_vulkanWindow->getCamera();
         
@@ -741,9 +2092,74 @@ void VulkanRayTracer::mainLoop()
                                 cameraUp        != lastCameraUp ||
                                 cameraFov       != lastCameraFov);
 
-        if (cameraChanged) 
+        // Quality settings can change per job, restart accumulation when they do
+        RayTracerSettings settings = getSettings();
+        if (m_statsShaderModule == VK_NULL_HANDLE) 
+            settings.specialization.coherenceStats = VK_FALSE; // The device lacks the subgroup operations, already warned about
+        RayTracerSettings accumulationSettings = settings;
+        accumulationSettings.denoiser = lastSettings.denoiser; // Only filters what is displayed
+        bool settingsChanged = (accumulationSettings != lastSettings);
+        lastSettings = settings;
+
+        // Follows the window, only the images and reservoirs are recreated. Old images wait for the frames sampling them
+        destroyRetiredImages(false);
+
+        VkExtent2D renderExtent = getRenderExtent();
+        bool resizePending = renderExtent.width != m_renderExtent.width || renderExtent.height != m_renderExtent.height;
+        if (resizePending && !hasRetiredImages()) 
+        {
+            if (!resizeRenderTargets(renderExtent)) 
+                break;
+            settingsChanged = true;
+        }
+
+        if (settingsChanged) 
+            historyValid = false;
+
+        // Enabled per job, a new mask also means a new pipeline variant and a restart
+        if (settings.specialization.aovMask != m_aovMask && !createAovTargets(settings.specialization.aovMask)) 
+            break;
+
+        // Also a settings change, so the next batch is the first one and fills the new buffer
+        if (settings.visibilityLayers != m_visibilityLayers && !createVisibilityTargets(settings.visibilityLayers)) 
+            break;
+
+        if (m_aovExportRequested.exchange(false)) 
+        {
+            QString directory;
+            {
+                std::lock_guard<std::mutex> lock(m_settingsMutex);
+                directory = m_aovExportDirectory;
+            }
+            exportAovs(directory);
+        }
+
+        // Created once and then kept, turning the denoiser off again only stops using them
+        if (settings.denoiser.enabled && m_denoisedImages[0].getImageView() == VK_NULL_HANDLE && !createDenoiseTargets()) 
+            qWarning("Failed to create denoiser targets, showing the raw accumulation");
+
+        // The first frame after loading or a settings change is not camera motion
+        if (cameraChanged && lastCameraFov >= 0.0f && settings.previewStride > 1) 
+        {
+            cameraMoving = true;
+            stillTimer.restart();
+        }
+
+        // Settled, the full resolution image starts from scratch
+        if (cameraMoving && nextTile == 0 && stillTimer.elapsed() >= settings.previewSettleMs) 
+        {
+            cameraMoving        = false;
+            sampleBatch         = 0;
+            pendingPublishImage = -1;
+        }
+
+        if (cameraChanged || settingsChanged) 
         {
-            sampleBatch         = 0;  // Reset samples when camera changes
+            // Queued submits keep their own copy of the camera uniform, so they are left to finish.
+            // A batch that is partly submitted is abandoned here, its remaining tiles are never recorded
+            sampleBatch         = 0;  // Reset samples when camera changes, the history is reprojected
+            nextTile            = 0;
+            pendingPublishImage = -1;
             shouldRayTrace      = true;  // Enable ray tracing
             
             // Update last known camera parameters
@@ -751,116 +2167,310 @@ void VulkanRayTracer::mainLoop()
             lastCameraDirection = cameraDirection;
             lastCameraUp        = cameraUp;
             lastCameraFov       = cameraFov;
+
+            // Update uniform data, copied into the ring with every submit
+            cameraUniform[0] = QVector4D(cameraPosition, 0.0f);
+            cameraUniform[1] = QVector4D(cameraDirection, 0.0f);
+            cameraUniform[2] = QVector4D(cameraUp, 0.0f);
+            cameraUniform[3] = QVector4D(cameraFov, 0.0f, 0.0f, 0.0f);
+            cameraUniform[4] = QVector4D(settings.aperture, settings.focalDistance, 0.0f, 0.0f);
         }
 
         if (shouldRayTrace) // RayTrace state
         {
-            m_rayTraceTimer.start();
+            RayTracerSpecialization specialization = settings.specialization;
 
-            // Update uniform buffer
-            m_uniformBuffer.copyData(&cameraPosition,   UNIFORM_VECTOR_DATA_SIZE, UNIFORM_VECTOR_DATA_SIZE * 0);
-            m_uniformBuffer.copyData(&cameraDirection,  UNIFORM_VECTOR_DATA_SIZE, UNIFORM_VECTOR_DATA_SIZE * 1);
-            m_uniformBuffer.copyData(&cameraUp,         UNIFORM_VECTOR_DATA_SIZE, UNIFORM_VECTOR_DATA_SIZE * 2);
-            m_uniformBuffer.copyData(&cameraFov,        UNIFORM_VECTOR_DATA_SIZE, UNIFORM_VECTOR_DATA_SIZE * 3);
+            // Only between batches, the tiles of one batch all run the same shader. The old samples were
+            // computed by a different shader, so accumulation starts over
+            if (nextTile == 0 && swapReloadedComputeShader(specialization)) 
+            {
+                sampleBatch         = 0;
+                pendingPublishImage = -1;
+                historyValid        = false;
+            }
 
-            VulkanCommandBuffer commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
+            // Until the variant is compiled the renderer keeps showing its placeholder or the last published image
+            bool pipelineFailed = false;
+            VkPipeline computePipeline = getComputePipeline(specialization, pipelineFailed);
 
-            commandBuffer.beginSingleTimeCommandBuffer();
+            // A variant the current shader can't build, e.g. after a reload, leaves the last one that worked running
+            if (pipelineFailed) 
+            {
+                auto lastGoodPipeline = m_lastGoodSpecialization ? m_computePipelines.find(*m_lastGoodSpecialization) : m_computePipelines.end();
+                if (lastGoodPipeline == m_computePipelines.end()) 
+                    break;
 
-            VkImageMemoryBarrier imageMemoryBarrierToGeneral
+                specialization  = lastGoodPipeline->first;
+                computePipeline = lastGoodPipeline->second;
+            }
+            if (computePipeline == VK_NULL_HANDLE) 
             {
-                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-                .pNext = nullptr,
-                .srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
-                .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                .image = m_storageImage.getImage(),
-                .subresourceRange = {
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .baseMipLevel = 0,
-                    .levelCount = 1,
-                    .baseArrayLayer = 0,
-                    .layerCount = 1
-                }
-            };  
+                QThread::msleep(1);
+                continue;
+            }
+            m_lastGoodSpecialization = specialization;
 
-            m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            0,
-            0, nullptr,
-            0, nullptr, 
-            1, &imageMemoryBarrierToGeneral);   
+            bool transferOwnership = m_computeQueueFamilyIndex != m_graphicsQueueFamilyIndex;
+            bool isFirstSubmit = nextTile == 0;
+
+            // The final image is always handed over, so it waits until the renderer picked up the previous one.
+            // Anything else published in the meantime would stay with the graphics side while the window is hidden
+            if (isFirstSubmit && !cameraMoving && sampleBatch + 1 >= NUM_SAMPLE_BATCHES && !isPublishedImageConsumed()) 
+            {
+                QThread::msleep(1);
+                continue;
+            }
 
-            m_deviceFunctions->vkCmdBindPipeline(commandBuffer.getCommandBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipeline);
+            // Blocks only while every other image is displayed or still sampled by frames in flight
+            if (isFirstSubmit) 
+            {
+                previewBatch = cameraMoving;
+                pixelStride  = previewBatch ? settings.previewStride : 1;
+
+                outputImage = acquireAccumulationImage(historyImage, acquireOwnership);
+                if (outputImage == UINT32_MAX) 
+                    break;
+
+                // Previews never read the history, so the last full resolution image is what the settled camera reprojects
+                std::array<QVector4D, 4> batchCamera = { cameraUniform[0], cameraUniform[1], cameraUniform[2], cameraUniform[3] };
+                if (previewBatch || !historyValid) 
+                    historyMode = HISTORY_NONE;
+                else if (imageCameras[historyImage] == batchCamera) 
+                    historyMode = HISTORY_SAME_VIEW;
+                else 
+                    historyMode = HISTORY_REPROJECT;
+
+                std::copy(imageCameras[historyImage].begin(), imageCameras[historyImage].end(), cameraUniform.begin() + 5);
+                imageCameras[outputImage] = batchCamera;
+            }
+
+            // Re-recording waits for the submit made BATCHES_IN_FLIGHT iterations ago, the others keep the GPU busy
+            uint32_t slot = m_batchTimelineValue % BATCHES_IN_FLIGHT;
+            VulkanCommandBuffer& commandBuffer = m_batchCommandBuffers[slot];
+
+            m_batchTimeline.wait(m_batchSlotValues[slot]);
+            updateTilesPerSubmit(slot);
 
-            m_deviceFunctions->vkCmdBindDescriptorSets(commandBuffer.getCommandBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+            // A preview tile costs about 1 / stride^2 of a full one
+            uint32_t tileEnd = std::min(nextTile + m_tilesPerSubmit * pixelStride * pixelStride, m_tileCount);
+            bool isLastSubmit = tileEnd == m_tileCount;
 
-            // Push constants
-            pushConstants.sample_batch = sampleBatch;
-            vkCmdPushConstants(commandBuffer.getCommandBuffer(),
-                            m_pipelineLayout,
-                            VK_SHADER_STAGE_COMPUTE_BIT,
-                            0,
-                            sizeof(PushConstants),
-                            &pushConstants);               
+            // The slot's region was last read by the submit waited for above
+            m_uniformRing.beginRegion(slot);
+            uint32_t uniformOffset = uint32_t(m_uniformRing.allocate(cameraUniform.data(), sizeof(cameraUniform), m_uniformAlignment));
 
-            m_deviceFunctions->vkCmdDispatch(commandBuffer.getCommandBuffer(),
-                        (uint32_t(render_width) + workgroup_width - 1) / workgroup_width,
-                        (uint32_t(render_height) + workgroup_height - 1) / workgroup_height, 1);
+            commandBuffer.beginCommandBuffer();
 
-            VkImageMemoryBarrier imageMemoryBarrierToTransferSrc
+            m_timestampQueries.reset(commandBuffer.getCommandBuffer(), 2 * slot, 2);
+            m_timestampQueries.writeTimestamp(commandBuffer.getCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 2 * slot);
+
+            // The previous batch's image and reservoirs are read by this one
+            VkMemoryBarrier batchMemoryBarrier
             {
-                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
                 .pNext = nullptr,
-                .srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
-                .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-                .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                .image = m_storageImage.getImage(),
-                .subresourceRange = {
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .baseMipLevel = 0,
-                    .levelCount = 1,
-                    .baseArrayLayer = 0,
-                    .layerCount = 1
-                }
-            };  
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            };
 
             m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             0,
-            0, nullptr,
+            1, &batchMemoryBarrier,
             0, nullptr, 
-            1, &imageMemoryBarrierToTransferSrc);   
+            0, nullptr);   
 
-            commandBuffer.endSubmitAndWait();
+            // A returned image was released by the renderer in a frame that has completed since
+            if (transferOwnership && isFirstSubmit && acquireOwnership) 
+            {
+                VkImageMemoryBarrier acquireBarrier = ownershipBarrier(outputImage, false, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+                m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0,
+                0, nullptr,
+                0, nullptr, 
+                1, &acquireBarrier);
+            }
 
-            VkFence fence = commandBuffer.getFence();
-            m_vulkanWindow->getVulkanRenderer()->copyStorageImage(fence);
+            m_deviceFunctions->vkCmdBindPipeline(commandBuffer.getCommandBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
 
-            // Timing and debug output
-            m_rayTraceTimeNs = m_rayTraceTimer.nsecsElapsed();
-            double fps = 1e9/(static_cast<double>(m_rayTraceTimeNs));
-            qDebug().nospace() << "Render time: " << (m_rayTraceTimeNs / 1.0e6) << " ms, FPS: " << fps;
-            qDebug("Storage image copied! sampleBatch: %i", sampleBatch);
+            m_deviceFunctions->vkCmdBindDescriptorSets(commandBuffer.getCommandBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 1, &uniformOffset);
 
-            sampleBatch++;  // Increment sample batch
-            
-            if (sampleBatch >= NUM_SAMPLE_BATCHES) 
+            // Tiles of one batch touch disjoint pixels and only read the previous batch, so they need no barriers in between
+            for (uint32_t tile = nextTile; tile < tileEnd; ++tile) 
+            {
+                uint32_t tileX = (tile % m_tileColumns) * TILE_SIZE;
+                uint32_t tileY = (tile / m_tileColumns) * TILE_SIZE;
+
+                // Push constants, the only values that differ between queued dispatches
+                pushConstants.sample_batch  = sampleBatch;
+                pushConstants.output_image  = outputImage;
+                pushConstants.history_image = historyImage;
+                pushConstants.tile_x        = tileX;
+                pushConstants.tile_y        = tileY;
+                pushConstants.tile_width    = std::min(TILE_SIZE, m_renderExtent.width - tileX);
+                pushConstants.tile_height   = std::min(TILE_SIZE, m_renderExtent.height - tileY);
+                pushConstants.pixel_stride  = pixelStride;
+                pushConstants.history_mode  = historyMode;
+                pushConstants.visibility_layers = m_visibilityLayers;
+                vkCmdPushConstants(commandBuffer.getCommandBuffer(),
+                                m_pipelineLayout,
+                                VK_SHADER_STAGE_COMPUTE_BIT,
+                                0,
+                                sizeof(PushConstants),
+                                &pushConstants);               
+
+                uint32_t invocationsX = (pushConstants.tile_width + pixelStride - 1) / pixelStride;
+                uint32_t invocationsY = (pushConstants.tile_height + pixelStride - 1) / pixelStride;
+                m_deviceFunctions->vkCmdDispatch(commandBuffer.getCommandBuffer(),
+                            (invocationsX + specialization.workgroupWidth - 1) / specialization.workgroupWidth,
+                            (invocationsY + specialization.workgroupHeight - 1) / specialization.workgroupHeight, 1);
+            }
+
+            m_timestampQueries.writeTimestamp(commandBuffer.getCommandBuffer(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2 * slot + 1);
+            m_slotTileCounts[slot] = tileEnd - nextTile;
+            m_slotPixelStrides[slot] = pixelStride;
+            nextTile = isLastSubmit ? 0 : tileEnd;
+
+            int32_t publishedImage = -1;
+
+            if (isLastSubmit) 
             {
-                shouldRayTrace = false;
+                // Make the result visible to the fragment shader that samples it once the batch has signaled
+                VkMemoryBarrier displayMemoryBarrier
+                {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                    .pNext = nullptr,
+                    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+                };
+
+                m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                0,
+                1, &displayMemoryBarrier,
+                0, nullptr, 
+                0, nullptr);   
+
+                // logCoherenceStats() waits for this batch on the timeline before it reads the counters
+                if (specialization.coherenceStats) 
+                {
+                    VkMemoryBarrier hostMemoryBarrier
+                    {
+                        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                        .pNext = nullptr,
+                        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                        .dstAccessMask = VK_ACCESS_HOST_READ_BIT
+                    };
+
+                    m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_HOST_BIT,
+                    0,
+                    1, &hostMemoryBarrier,
+                    0, nullptr, 
+                    0, nullptr);   
+                }
+
+                // A restart and the final batch are always shown, everything in between at the pace the display takes it.
+                // Released images can't be read here anymore, so an image is handed over by the batch after it, once it
+                // served as history. The final batch has no successor and hands over its own output
+                // A preview is never read back either, so it is handed over right away as well
+                // Only one image is ever waiting for the renderer. A hidden window picks up none, and images it never
+                // hands back would leave acquireAccumulationImage() without an output
+                bool isFinalBatch = sampleBatch + 1 >= NUM_SAMPLE_BATCHES;
+                bool releasesOwnOutput = isFinalBatch || previewBatch;
+                bool canPublish = isPublishedImageConsumed() && (releasesOwnOutput || pendingPublishImage < 0);
+                bool publishOutput = canPublish && (sampleBatch == 0 || releasesOwnOutput || m_presentationScheduler.shouldPublish());
+                if (publishOutput) 
+                    m_presentationScheduler.onPublished();
+
+                if (releasesOwnOutput) 
+                    publishedImage = publishOutput ? int32_t(outputImage) : -1;
+                else if (sampleBatch > 0) 
+                    publishedImage = pendingPublishImage;
+                pendingPublishImage = (publishOutput && !releasesOwnOutput) ? int32_t(outputImage) : -1;
+
+                // Previews are too coarse for their features to guide the filter. The raw image stays untouched either way
+                if (publishedImage >= 0) 
+                {
+                    bool denoise = settings.denoiser.enabled && !previewBatch && m_denoiser.isReady();
+                    if (denoise) 
+                    {
+                        m_denoiser.record(commandBuffer.getCommandBuffer(), uint32_t(publishedImage), settings.denoiser);
+
+                        m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                        0,
+                        1, &displayMemoryBarrier,
+                        0, nullptr, 
+                        0, nullptr);
+                    }
+
+                    std::lock_guard<std::mutex> lock(m_displayMutex);
+                    m_publishedDenoised[publishedImage] = denoise;
+                }
+
+                if (transferOwnership && publishedImage >= 0) 
+                {
+                    VkImageMemoryBarrier releaseBarrier = ownershipBarrier(uint32_t(publishedImage), true, VK_ACCESS_SHADER_WRITE_BIT, 0);
+
+                    m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                    0,
+                    0, nullptr,
+                    0, nullptr, 
+                    1, &releaseBarrier);
+                }
+            }
+
+            uint64_t batchValue = ++m_batchTimelineValue;
+            commandBuffer.endAndSubmit({ .signalSemaphore = m_batchTimeline.getSemaphore(), .signalValue = batchValue });
+            m_batchSlotValues[slot] = batchValue;
+
+            if (isLastSubmit) 
+            {
+                // Previews leave the history alone. An image released with the final batch belongs to the renderer
+                if (!previewBatch) 
+                {
+                    std::lock_guard<std::mutex> lock(m_displayMutex);
+                    m_writtenImage = int32_t(outputImage);
+                    historyValid = sampleBatch + 1 < NUM_SAMPLE_BATCHES;
+                }
+                m_presentationScheduler.onBatchCompleted();
+
+                if (publishedImage >= 0) 
+                    publishAccumulationImage(uint32_t(publishedImage), batchValue);
+
+                if (specialization.coherenceStats) 
+                    logCoherenceStats(batchValue);
+
+                // With the ring full this is the GPU time per batch, PresentationScheduler keeps the batch and present rates
+                m_rayTraceTimeNs = m_rayTraceTimer.nsecsElapsed();
+                m_rayTraceTimer.restart();
+
+                // Previews stay at sample 0 until the camera settles
+                if (!previewBatch) 
+                    sampleBatch++;
+                
+                if (sampleBatch >= NUM_SAMPLE_BATCHES) 
+                {
+                    shouldRayTrace = false;
+                }
             }
         }
         // Add small sleep when not ray tracing to reduce CPU usage
         else {
             QThread::msleep(16); // ~60 FPS idle
+            m_rayTraceTimer.restart();
         }
     }
+
+    waitForBatches();
 }
\ No newline at end of file
@@ -3,57 +3,262 @@
 #include <vulkan/vulkan.h>
 #include <QVulkanDeviceFunctions>
 #include <QElapsedTimer>
+#include <QSize>
+#include <array>
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "VulkanBuffer.h"
+#include "VulkanRingBuffer.h"
 #include "VulkanImage.h"
 #include "VulkanCommandPool.h"
 #include "VulkanCommandBuffer.h"
+#include "VulkanTimelineSemaphore.h"
+#include "VulkanQueryPool.h"
+#include "VulkanPipelineCache.h"
+#include "VulkanDenoiser.h"
+#include "PresentationScheduler.h"
 
 class VulkanWindow;
 
+// Per-pixel outputs besides the beauty image, bits of RayTracerSpecialization::aovMask, written by requestAovExport().
+// Albedo, normal and depth are the surface features that guide the denoiser, averaged over the same samples as the
+// beauty image and always kept. Only the triangle id needs an image of its own, it keeps the latest sample's
+enum RayTracerAov : uint32_t
+{
+    AOV_ALBEDO      = 1 << 0,
+    AOV_NORMAL      = 1 << 1,   // World space, facing the camera
+    AOV_DEPTH       = 1 << 2,   // Camera hit distance, misses count as 0
+    AOV_TRIANGLE_ID = 1 << 3,   // Index + 1 split into 16 bit halves in red and green, 0 for misses and area lights
+};
+
+// Values baked into raytrace_comp.comp as specialization constants, every combination is a separate pipeline variant
+struct RayTracerSpecialization
+{
+    uint32_t workgroupWidth   = 16;
+    uint32_t workgroupHeight  = 16;
+    int32_t maxDepth          = 4;
+    int32_t sssMaxBounces     = 3;
+    int32_t rouletteMinDepth  = 2; // Russian roulette starts after this many bounces
+    int32_t restirCandidates  = 8; // Emitter candidates resampled per pixel at the camera hit, 0 disables reservoir reuse
+    int32_t restirNeighbours  = 3; // Spatial neighbours merged from the previous batch
+    uint32_t aovMask          = 0; // RayTracerAov bits, a disabled triangle id is compiled out and gets no full size image
+    VkBool32 sortSecondaryRays = VK_FALSE; // Reorder bounce rays within each workgroup before tracing, needs at most 256 invocations
+    VkBool32 coherenceStats    = VK_FALSE; // Count distinct BVH nodes fetched per subgroup by bounce rays, logged once per second
+
+    auto operator<=>(const RayTracerSpecialization&) const = default;
+};
+
+struct RayTracerSettings
+{
+    RayTracerSpecialization specialization{};
+    float aperture      = 0.02f; // Passed through the camera uniform, changing it does not need a new pipeline
+    float focalDistance = 3.0f;
+    float renderScale   = 1.0f;  // Fraction of the swapchain size that is traced, in [0.1, 1]
+    uint32_t previewStride  = 4;    // Pixel stride while the camera moves, 1 disables the preview
+    int previewSettleMs     = 250;  // Stillness needed before full resolution accumulation starts
+    uint32_t visibilityLayers = 0;  // Camera rays per pixel whose hits are cached and reused, 0 traces every camera ray.
+                                    // Each one fixes a sub-pixel offset and a lens sample, so depth of field is sampled
+                                    // with only this many lens positions
+    DenoiserSettings denoiser{};    // Only changes what is displayed, the accumulation keeps going
+
+    bool operator==(const RayTracerSettings&) const = default;
+};
+
 class VulkanRayTracer 
 {
 public:
     VulkanRayTracer(VulkanWindow* w);
+    ~VulkanRayTracer();
+
+    // Called by VulkanRenderer once per frame before its render pass, returns the newest finished accumulation image
+    // (VK_NULL_HANDLE before the first batch). Queue family ownership transfers are recorded into commandBuffer
+    VkImageView acquireDisplayImage(uint64_t frame, VkCommandBuffer commandBuffer);
+
+    PresentationScheduler& getPresentationScheduler() { return m_presentationScheduler; }
 
-    VkImage getStorageImage() { return m_storageImage.getImage(); }
-    void initRayTracer();
+    // Worker thread lifecycle, stop() cancels scene loading or accumulation and joins after teardown
+    void start();
+    void requestStop();
+    void stop();
+    bool isRunning() const { return m_running; }
+
+    void setSettings(const RayTracerSettings& settings);
+    RayTracerSettings getSettings();
+
+    // Equirectangular .hdr lighting the scene, read once by start(). A missing file leaves missed rays black
+    static constexpr const char* DEFAULT_ENVIRONMENT_PATH = "../scenes/environment.hdr";
+    void setEnvironmentPath(const std::string& path);
+
+    // Called by VulkanRenderer whenever the swapchain is (re)created. The tracer follows between batches
+    void setSwapChainSize(const QSize& swapChainSize);
+
+    // Thread-safe. The shader is loaded from spirvPath and compiled in the background, its pipeline replaces the
+    // running one before the next sample batch. Geometry and other buffers are kept. shaderName is raytrace_comp or
+    // its coherence stats build raytrace_stats_comp
+    void reloadComputeShader(const QString& shaderName, const QString& spirvPath);
+
+    // Thread-safe. The scene's triangles as soon as the OBJ is parsed, PREVIEW_VERTEX_FLOATS per vertex (position,
+    // flat normal, uv) for the renderer's raster preview. Empty before that and after the first successful call
+    static constexpr uint32_t PREVIEW_VERTEX_FLOATS = 8;
+    std::vector<float> takePreviewVertices();
+
+    // Thread-safe. Writes the AOVs enabled in the specialization's aovMask as PFM files into directory, between batches
+    // and for the newest finished full resolution batch
+    void requestAovExport(const QString& directory);
 
 private:
-    void initComputePipeline();
+    bool initComputePipeline();
+    void releaseComputePipeline();
     void mainLoop();
+    void waitForBatches();
+    void updateTilesPerSubmit(uint32_t slot);
+
+    VkExtent2D getRenderExtent();
+    bool createRenderTargets(VkExtent2D renderExtent);
+    bool resizeRenderTargets(VkExtent2D renderExtent);
+    void destroyRetiredImages(bool force);
+    bool hasRetiredImages();
+    bool createDenoiseTargets();
+    bool createAovTargets(uint32_t aovMask);
+    bool exportAovs(const QString& directory);
+    bool createVisibilityTargets(uint32_t visibilityLayers);
+    void transitionToGeneral(std::span<const VulkanImage> images);
+    void logCoherenceStats(uint64_t batchValue);
+
+    uint32_t acquireAccumulationImage(uint32_t& historyImage, bool& acquireOwnership);
+    void publishAccumulationImage(uint32_t imageIndex, uint64_t batchValue);
+    bool isPublishedImageConsumed();
+    const VulkanImage& getPublishedImage(uint32_t imageIndex) const;
+    VkImageMemoryBarrier ownershipBarrier(uint32_t imageIndex, bool toGraphics, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) const;
+
+    // Variants compile on a thread of their own. getComputePipeline() returns VK_NULL_HANDLE until the variant is ready
+    // and sets failed if it could not be created
+    void requestComputePipeline(const RayTracerSpecialization& specialization);
+    VkPipeline getComputePipeline(const RayTracerSpecialization& specialization, bool& failed);
+    VkPipeline compileComputePipeline(const RayTracerSpecialization& specialization, VkShaderModule shaderModule);
+    bool swapReloadedComputeShader(const RayTracerSpecialization& specialization);
+    bool createShaderModules(VkShaderModule& computeShaderModule, VkShaderModule& statsShaderModule);
+    bool querySubgroupStatsSupport();
+    void destroyComputePipelines();
 
     VulkanWindow* m_vulkanWindow = nullptr;
 
     VulkanBuffer m_vertexBuffer{};
-    VulkanBuffer m_vertexStagingBuffer{};
-
     VulkanBuffer m_indexBuffer{};
-    VulkanBuffer m_indexStagingBuffer{};
-
     VulkanBuffer m_BVHBuffer{};
-    VulkanBuffer m_BVHStagingBuffer{};
-
     VulkanBuffer m_lightBuffer{};
-    VulkanBuffer m_lightStagingBuffer{};
-
     VulkanBuffer m_UVBuffer{};
-    VulkanBuffer m_UVStagingBuffer{};
-
     VulkanBuffer m_materialIndexBuffer{};
-    VulkanBuffer m_materialIndexStagingBuffer{};
+    VulkanBuffer m_emissiveTriangleBuffer{};
+    VulkanBuffer m_lightSamplerBuffer{};
+    VulkanBuffer m_materialBuffer{};
+    VulkanBuffer m_environmentBuffer{};
+    VulkanBuffer m_environmentDistributionBuffer{};
+    VulkanBuffer m_reservoirBuffer{};
+    VulkanBuffer m_surfaceFeatureBuffer{};
+    VulkanBuffer m_visibilityBuffer{};  // Triangle hit by each pixel per visibility layer, a placeholder while disabled
+    uint32_t m_visibilityLayers = 0;
+
+    // Host-visible counters of CoherenceStats in raytrace_comp.comp. They only grow, the log shows the difference
+    // to the values read a second earlier
+    VulkanBuffer m_coherenceStatsBuffer{};
+    std::array<uint32_t, 3> m_loggedCoherenceStats{};
+    QElapsedTimer m_coherenceStatsTimer{};
+
+    VulkanRingBuffer m_uniformRing{};
+    VkDeviceSize m_uniformAlignment = 1;
+
+    // Each batch reads the image written before it and writes another one, the renderer samples the latest published one.
+    // Displayed, published, history and output can all differ, hence four
+    static constexpr uint32_t ACCUMULATION_IMAGE_COUNT = 4;
+    std::array<VulkanImage, ACCUMULATION_IMAGE_COUNT> m_accumulationImages{};
+
+    // Filtered copies shown instead of the accumulation image with the same index, created once denoising is first enabled.
+    // Ownership transfers move whichever of the two was published
+    VulkanDenoiser m_denoiser{};
+    std::array<VulkanImage, ACCUMULATION_IMAGE_COUNT> m_denoisedImages{};
+    std::array<bool, ACCUMULATION_IMAGE_COUNT> m_publishedDenoised{};
+    static_assert(ACCUMULATION_IMAGE_COUNT == VulkanDenoiser::IMAGE_COUNT);
+
+    // AOV_TRIANGLE_ID, written in place by every batch. A 1x1 placeholder while disabled
+    VulkanImage m_triangleIdImage{};
+    uint32_t m_aovMask = 0;
+
+    std::atomic<bool> m_aovExportRequested = false;
+    QString m_aovExportDirectory{};     // Guarded by m_settingsMutex
 
-    VulkanBuffer m_uniformBuffer{};
+    // Accumulation images and reservoirs are sized to the render extent, everything else is resolution independent
+    VkExtent2D m_renderExtent{};
+    uint32_t m_tileColumns = 0;
+    uint32_t m_tileRows = 0;
+    uint32_t m_tileCount = 0;
 
-    VulkanImage m_storageImage{};
+    // Replaced on resize but possibly still sampled by frames in flight, destroyed once m_displayFrame passes the frame.
+    // A second resize waits until they are gone. Accumulation images first, then the denoised ones
+    std::array<VulkanImage, 2 * ACCUMULATION_IMAGE_COUNT> m_retiredImages{};
+    bool m_hasRetiredImages = false;
+    uint64_t m_retiredImagesFrame = 0;
+
+    PresentationScheduler m_presentationScheduler{};
+
+    std::mutex m_displayMutex{};
+    int32_t m_latestImage = -1;
+    uint64_t m_latestBatchValue = 0;
+    int32_t m_displayedImage = -1;
+    int32_t m_writtenImage = -1;
+    uint64_t m_displayFrame = 0;
+    std::array<uint64_t, ACCUMULATION_IMAGE_COUNT> m_imageRetireFrames{}; // First frame after which no frame in flight samples the image
+
+    // Which queue family may touch an image. Released images wait for the matching acquire on the other side,
+    // the barriers are only recorded when the compute and graphics families differ
+    enum class ImageOwner { Compute, ReleasedToGraphics, Graphics, ReleasedToCompute };
+    std::array<ImageOwner, ACCUMULATION_IMAGE_COUNT> m_imageOwners{};
 
     VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
     VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
     VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
 
-    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    VulkanPipelineCache m_pipelineCache{};
     VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
-    VkPipeline m_computePipeline = VK_NULL_HANDLE;
+    VkShaderModule m_computeShaderModule = VK_NULL_HANDLE;
+    VkShaderModule m_statsShaderModule = VK_NULL_HANDLE;  // Used by the coherenceStats variants, only loaded when supported
+    bool m_subgroupStatsSupported = false;
+    std::map<RayTracerSpecialization, VkPipeline> m_computePipelines{};
+    std::map<RayTracerSpecialization, std::future<VkPipeline>> m_pendingPipelines{};
+    std::set<RayTracerSpecialization> m_failedPipelines{};              // Not retried until the shader module changes
+    std::optional<RayTracerSpecialization> m_lastGoodSpecialization{};  // Fallback for variants that failed
+
+    // Set by reloadComputeShader(), also used when the pipeline is recreated. The reloaded module and its first
+    // pipeline are held here until that pipeline is ready, the running ones are used in the meantime
+    std::mutex m_shaderMutex{};
+    QString m_computeShaderPath = QStringLiteral(":/raytrace_comp.spv");
+    QString m_statsShaderPath = QStringLiteral(":/raytrace_stats_comp.spv");
+    std::atomic<bool> m_shaderReloadRequested = false;
+    VkShaderModule m_reloadShaderModule = VK_NULL_HANDLE;
+    VkShaderModule m_reloadStatsShaderModule = VK_NULL_HANDLE;
+    RayTracerSpecialization m_reloadSpecialization{};
+    std::future<VkPipeline> m_reloadPipeline{};
+
+    std::thread m_workerThread{};
+    std::atomic<bool> m_stopRequested = false;
+    std::atomic<bool> m_running = false;
+
+    std::mutex m_previewMutex{};
+    std::vector<float> m_previewVertices{};
+
+    std::mutex m_settingsMutex{};
+    RayTracerSettings m_settings{};
+    std::string m_environmentPath = DEFAULT_ENVIRONMENT_PATH;   // Guarded by m_settingsMutex
+    QSize m_swapChainSize{}; // Empty until the renderer creates its swapchain, the targets start at 1x1 then
 
     VkQueue m_graphicsQueue = VK_NULL_HANDLE;
     VkQueue m_computeQueue = VK_NULL_HANDLE;
@@ -63,6 +268,25 @@ private:
 
     VulkanCommandPool m_computeCommandPool{};
 
+    // Submits queued on the GPU at once, each slot is reset and re-recorded once the timeline passed its submit
+    static constexpr uint32_t BATCHES_IN_FLIGHT = 3;
+    std::array<VulkanCommandBuffer, BATCHES_IN_FLIGHT> m_batchCommandBuffers{};
+    std::array<uint64_t, BATCHES_IN_FLIGHT> m_batchSlotValues{};
+
+    // Signaled with the number of submits when each one finishes, a batch is done once its last submit is
+    VulkanTimelineSemaphore m_batchTimeline{};
+    uint64_t m_batchTimelineValue = 0;
+
+    // Batches are dispatched in square tiles (TILE_SIZE in VulkanRayTracer.cpp, m_tileCount per batch), as many per submit as fit in the budget by the measured GPU time per tile.
+    // Short submits keep the GPU responsive for the display and let a camera change cancel mid-batch
+    static constexpr double SUBMIT_BUDGET_NS = 8.0e6;
+    VulkanQueryPool m_timestampQueries{};
+    float m_timestampPeriod = 1.0f;
+    double m_tileTimeNs = 0.0;
+    uint32_t m_tilesPerSubmit = 4;
+    std::array<uint32_t, BATCHES_IN_FLIGHT> m_slotTileCounts{};
+    std::array<uint32_t, BATCHES_IN_FLIGHT> m_slotPixelStrides{};
+
     QElapsedTimer m_rayTraceTimer{};
     qint64 m_rayTraceTimeNs{};
     
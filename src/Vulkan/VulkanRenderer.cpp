@@ -1,10 +1,8 @@
 #include "VulkanRenderer.h"
 #include "VulkanWindow.h"
 #include <QVulkanFunctions>
-#include <thread>
+#include <QScreen>
 
-static const uint64_t render_width     = 1024; // TODO: Pass this data dynamically through Qt's GUI
-static const uint64_t render_height    = 1024;
 static const uint32_t workgroup_width  = 16;
 static const uint32_t workgroup_height = 16;
 
@@ -24,6 +22,16 @@ static float vertexData[] = {
 static const int UNIFORM_MATRIX_DATA_SIZE = 16 * sizeof(float);
 static const int UNIFORM_VECTOR_DATA_SIZE = 3 * sizeof(float);
 
+// Samples per pixel after which the path-traced image fully covers the raster preview
+static const float PREVIEW_FADE_SAMPLES = 4.0f;
+
+// PushConsts in color_vert.vert and color_frag.frag
+struct DrawPushConstants
+{
+    uint32_t meshPass;
+    float fadeSamples;
+};
+
 static inline VkDeviceSize aligned(VkDeviceSize v, VkDeviceSize byteAlign)
 {
     return (v + byteAlign - 1) & ~(byteAlign - 1);
@@ -51,16 +59,12 @@ void VulkanRenderer::initResources()
     m_device = m_vulkanWindow->device();
     m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_device);
 
-    m_graphicsQueueFamilyIndex = m_vulkanWindow->findQueueFamilyIndex(m_vulkanWindow->physicalDevice(), VK_QUEUE_GRAPHICS_BIT);
-    if (m_graphicsQueueFamilyIndex == UINT32_MAX)
-        qDebug("No suitable graphics queue family found!");
-        
-    m_computeQueueFamilyIndex = m_vulkanWindow->findQueueFamilyIndex(m_vulkanWindow->physicalDevice(), VK_QUEUE_COMPUTE_BIT);
-    if (m_computeQueueFamilyIndex == UINT32_MAX)
-        qDebug("No suitable compute queue family found!");
+    // The queue QVulkanWindow submits frames to
+    m_graphicsQueueFamilyIndex = m_vulkanWindow->graphicsQueueFamilyIndex();
+    m_computeQueueFamilyIndex = m_vulkanWindow->getComputeQueueFamilyIndex();
 
-    m_deviceFunctions->vkGetDeviceQueue(m_device, m_graphicsQueueFamilyIndex, 0, &m_graphicsQueue);
-    m_deviceFunctions->vkGetDeviceQueue(m_device, m_computeQueueFamilyIndex, 0, &m_computeQueue);
+    m_graphicsQueue = m_vulkanWindow->graphicsQueue();
+    m_deviceFunctions->vkGetDeviceQueue(m_device, m_computeQueueFamilyIndex, m_vulkanWindow->getComputeQueueIndex(), &m_computeQueue);
 
     m_graphicsCommandPool = VulkanCommandPool(m_vulkanWindow, m_graphicsQueueFamilyIndex);
     m_computeCommandPool = VulkanCommandPool(m_vulkanWindow, m_computeQueueFamilyIndex);
@@ -108,11 +112,12 @@ void VulkanRenderer::initResources()
     }
 
     /////////////////////////////////////////////////////////////////////
-    // Create image
+    // Create placeholder image
     /////////////////////////////////////////////////////////////////////
 
+    // Shown until the ray tracer finishes its first batch, afterwards its accumulation images are sampled directly
     m_renderImage = VulkanImage(m_vulkanWindow, 
-                                render_width, render_height, 
+                                1, 1, 
                                 VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 
                                 m_vulkanWindow->deviceLocalMemoryIndex());
 
@@ -121,24 +126,26 @@ void VulkanRenderer::initResources()
 
         commandBuffer.beginSingleTimeCommandBuffer();
 
-        VkImageMemoryBarrier imageMemoryBarrierToShaderRead
+        VkImageSubresourceRange subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        };
+
+        VkImageMemoryBarrier imageMemoryBarrierToTransferDst
         {
             .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
             .pNext = nullptr,
             .srcAccessMask = 0,
             .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
             .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .image = m_renderImage.getImage(),
-            .subresourceRange = {
-                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .baseMipLevel = 0,
-                .levelCount = 1,
-                .baseArrayLayer = 0,
-                .layerCount = 1
-            }
+            .subresourceRange = subresourceRange
         };  
 
         m_deviceFunctions->vkCmdPipelineBarrier(
@@ -148,68 +155,36 @@ void VulkanRenderer::initResources()
         0,
         0, nullptr,
         0, nullptr, 
-        1, &imageMemoryBarrierToShaderRead);   
+        1, &imageMemoryBarrierToTransferDst);   
 
-        // VkImageCopy bufferCopyRegion
-        // {
-        //     .srcSubresource = {
-        //         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        //         .mipLevel = 0,
-        //         .baseArrayLayer = 0,
-        //         .layerCount = 1
-        //     },
-        //     .srcOffset = {0, 0, 0},
-        //     .dstSubresource = {
-        //         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        //         .mipLevel = 0,
-        //         .baseArrayLayer = 0,
-        //         .layerCount = 1
-        //     },
-        //     .dstOffset = {0, 0, 0},
-        //     .extent = {
-        //         .width = render_width,
-        //         .height = render_height,
-        //         .depth = 1
-        //     }
-        // };
-
-        // VkImage storageImage = m_vulkanWindow->getVulkanRayTracer()->getStorageImage(); 
-
-        // m_deviceFunctions->vkCmdCopyImage(
-        //     commandBuffer.getCommandBuffer(), 
-        //     storageImage, 
-        //     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 
-        //     m_renderImage.getImage(), 
-        //     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-        //     1, &bufferCopyRegion);
-
-        // VkImageMemoryBarrier imageMemoryBarrierToShaderRead
-        // {
-        //     .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        //     .pNext = nullptr,
-        //     .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        //     .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-        //     .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        //     .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        //     .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        //     .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        //     .image = m_renderImage.getImage(),
-        //     .subresourceRange = {
-        //         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        //         .baseMipLevel = 0,
-        //         .levelCount = 1,
-        //         .baseArrayLayer = 0,
-        //         .layerCount = 1
-        //     }
-        // };  
-
-        // m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
-        // VK_PIPELINE_STAGE_TRANSFER_BIT,
-        // VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        // 0,
-        // 0, nullptr,
-        // 0, nullptr, 
-        // 1, &imageMemoryBarrierToShaderRead);   
+        VkClearColorValue placeholderColor = { .float32 = { 0.0f, 0.0f, 0.0f, 0.0f } }; // No samples, the raster preview shows through
+        m_deviceFunctions->vkCmdClearColorImage(commandBuffer.getCommandBuffer(), 
+                                                m_renderImage.getImage(), 
+                                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                                                &placeholderColor, 
+                                                1, &subresourceRange);
+
+        VkImageMemoryBarrier imageMemoryBarrierToShaderRead
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = m_renderImage.getImage(),
+            .subresourceRange = subresourceRange
+        };  
+
+        m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr, 
+        1, &imageMemoryBarrierToShaderRead);   
 
         commandBuffer.endSubmitAndWait();
     }
@@ -405,13 +380,14 @@ void VulkanRenderer::initResources()
     // Pipeline color blend state
     /////////////////////////////////////////////////////////////////////
 
+    // The path-traced image is blended over the raster preview by its fragment alpha, the framebuffer alpha is kept
     VkPipelineColorBlendAttachmentState pipelineColorBlendAttachmentState = {
-        .blendEnable = VK_FALSE,
-        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
         .colorBlendOp = VK_BLEND_OP_ADD,
-        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
         .alphaBlendOp = VK_BLEND_OP_ADD,
         .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
     };
@@ -541,50 +517,25 @@ void VulkanRenderer::initResources()
             .pTexelBufferView = nullptr
         };
 
-        VkDescriptorImageInfo m_descriptorImageInfo 
-        {
-            .sampler = m_renderImage.getSampler(),
-            .imageView = m_renderImage.getImageView(),
-            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-        };
+        m_deviceFunctions->vkUpdateDescriptorSets(m_device, 1, &uniformBufferWrite, 0, nullptr);
 
-        VkWriteDescriptorSet storageImageWrite
-        {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .pNext = nullptr,
-            .dstSet = m_descriptorSet[i],
-            .dstBinding = 1, // Binding 1 is for storage image
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .pImageInfo = &m_descriptorImageInfo,
-            .pBufferInfo = nullptr,
-            .pTexelBufferView = nullptr
-        };
-
-        VkWriteDescriptorSet descriptorWrites[] = { storageImageWrite, uniformBufferWrite };
-        
-        m_deviceFunctions->vkUpdateDescriptorSets(m_device, 2, descriptorWrites, 0, nullptr);
+        // Binding 1 starts on the placeholder and follows the ray tracer's accumulation images per frame
+        updateDisplayDescriptor(uint32_t(i), m_renderImage.getImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     }
 
     /////////////////////////////////////////////////////////////////////
     // Pipeline layout
     /////////////////////////////////////////////////////////////////////
 
-    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
-        .initialDataSize = 0,
-        .pInitialData = nullptr
-    };
+    // Loaded from disk, written back in releaseResources()
+    m_pipelineCache = VulkanPipelineCache(m_vulkanWindow, QStringLiteral("renderer"));
 
-    m_result = m_deviceFunctions->vkCreatePipelineCache(m_device, &pipelineCacheCreateInfo, nullptr, &m_pipelineCache);
-    if (m_result != VK_SUCCESS)
-    {
-        qWarning("Failed to create pipeline cache (error code: %d)", m_result);
-        return;
-    }
+    // Selects between the mesh and the full-screen quad, both are drawn with the same pipeline
+    VkPushConstantRange pushConstantRange{
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = sizeof(DrawPushConstants)
+    };
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -592,8 +543,8 @@ void VulkanRenderer::initResources()
         .flags = 0,
         .setLayoutCount = 1,
         .pSetLayouts = &m_descriptorSetLayout,
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = nullptr
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
     };
 
     m_result = m_deviceFunctions->vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
@@ -629,7 +580,7 @@ void VulkanRenderer::initResources()
         .basePipelineIndex = -1
     };
 
-    m_result = m_deviceFunctions->vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &pipelineInfo, nullptr, &m_pipeline);
+    m_result = m_deviceFunctions->vkCreateGraphicsPipelines(m_device, m_pipelineCache.getPipelineCache(), 1, &pipelineInfo, nullptr, &m_pipeline);
     if (m_result != VK_SUCCESS)
     {
         qWarning("Failed to create graphics pipeline (error code: %d)", m_result);
@@ -637,14 +588,14 @@ void VulkanRenderer::initResources()
     }
 
     /////////////////////////////////////////////////////////////////////
-    // Initialize VulkanRayTracer in separate thread
+    // Start VulkanRayTracer on its worker thread
     /////////////////////////////////////////////////////////////////////
 
-    std::thread rayTracerThread([this]() {
-        m_vulkanWindow->getVulkanRayTracer()->initRayTracer();
-    });
+    // Accumulated images are published at most about once per refresh
+    QScreen* screen = m_vulkanWindow->screen();
+    m_vulkanWindow->getVulkanRayTracer()->getPresentationScheduler().setDisplayRate(screen ? screen->refreshRate() : 60.0);
 
-    rayTracerThread.detach();
+    m_vulkanWindow->getVulkanRayTracer()->start();
 
     /////////////////////////////////////////////////////////////////////
     // Clean up
@@ -661,6 +612,9 @@ void VulkanRenderer::initSwapChainResources()
     qDebug("initSwapChainResources");
 
     m_vulkanWindow->getCamera()->cameraSwapChainUpdate();
+
+    // The tracer reallocates its images at the new size, the scene buffers are kept
+    m_vulkanWindow->getVulkanRayTracer()->setSwapChainSize(m_vulkanWindow->swapChainImageSize());
 }
 
 void VulkanRenderer::releaseSwapChainResources()
@@ -672,6 +626,9 @@ void VulkanRenderer::releaseResources()
 {
     qDebug("releaseResources");
 
+    // Stopped first so no batch is left writing the images this renderer samples
+    m_vulkanWindow->getVulkanRayTracer()->stop();
+
     if (m_pipeline) 
     {
         m_deviceFunctions->vkDestroyPipeline(m_device, m_pipeline, nullptr);
@@ -684,11 +641,7 @@ void VulkanRenderer::releaseResources()
         m_pipelineLayout = VK_NULL_HANDLE;
     }
 
-    if (m_pipelineCache) 
-    {
-        m_deviceFunctions->vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
-        m_pipelineCache = VK_NULL_HANDLE;
-    }
+    m_pipelineCache.destroy();
 
     if (m_descriptorSetLayout) 
     {
@@ -702,11 +655,21 @@ void VulkanRenderer::releaseResources()
         m_descriptorPool = VK_NULL_HANDLE;
     }
 
-    // m_graphicsCommandPool.destroy();
-    // m_vertexBuffer.destroy();
-    // m_vertexStagingBuffer.destroy();
-    // m_uniformBuffer.destroy();
-    // m_renderImage.destroy();
+    // Their memory comes from the allocator's blocks, which are returned to the device below, so nothing may outlive it
+    m_graphicsCommandPool.destroy();
+    m_computeCommandPool.destroy();
+    m_vertexBuffer.destroy();
+    m_vertexStagingBuffer.destroy();
+    m_meshVertexBuffer.destroy();
+    m_meshStagingBuffer.destroy();
+    m_meshVertexCount = 0;
+    m_uniformBuffer.destroy();
+    m_renderImage.destroy();
+
+    m_vulkanWindow->getMemoryAllocator().logStatistics();
+
+    // The empty blocks kept for reuse go as well, Qt destroys the device after this
+    m_vulkanWindow->getMemoryAllocator().destroy();
 }
 
 void VulkanRenderer::startNextFrame()
@@ -732,6 +695,52 @@ void VulkanRenderer::startNextFrame()
                                     m_vertexBuffer.getBuffer(), 
                                     1, &bufferCopyRegion);
 
+    // The scene's triangles arrive once, well before the BVH is built and the first batch is traced
+    if (m_meshVertexCount == 0) 
+    {
+        std::vector<float> meshVertices = m_vulkanWindow->getVulkanRayTracer()->takePreviewVertices();
+        if (!meshVertices.empty()) 
+        {
+            VkDeviceSize meshSize = meshVertices.size() * sizeof(float);
+            m_meshVertexBuffer  = VulkanBuffer(m_vulkanWindow, 
+                                            meshSize, 
+                                            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+                                            m_vulkanWindow->deviceLocalMemoryIndex());
+            m_meshStagingBuffer = VulkanBuffer(m_vulkanWindow, 
+                                            meshSize, 
+                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+                                            m_vulkanWindow->hostVisibleMemoryIndex());
+
+            if (m_meshVertexBuffer.getBuffer() != VK_NULL_HANDLE && m_meshStagingBuffer.getBuffer() != VK_NULL_HANDLE) 
+            {
+                m_meshStagingBuffer.copyData(meshVertices.data(), meshSize);
+
+                VkBufferCopy meshCopyRegion = {
+                    .srcOffset = 0,
+                    .dstOffset = 0,
+                    .size = meshSize
+                };
+
+                m_deviceFunctions->vkCmdCopyBuffer(commandBuffer, 
+                                                m_meshStagingBuffer.getBuffer(), 
+                                                m_meshVertexBuffer.getBuffer(), 
+                                                1, &meshCopyRegion);
+
+                m_meshVertexCount   = uint32_t(meshVertices.size() / VulkanRayTracer::PREVIEW_VERTEX_FLOATS);
+                m_meshStagingFrame  = m_frameCount;
+            }
+            else 
+            {
+                qWarning("Failed to create the preview mesh buffers, showing the path-traced image only");
+                m_meshStagingBuffer.destroy();
+            }
+        }
+    }
+    else if (m_meshStagingBuffer.getBuffer() != VK_NULL_HANDLE && m_frameCount >= m_meshStagingFrame + uint64_t(m_vulkanWindow->concurrentFrameCount())) 
+    {
+        m_meshStagingBuffer.destroy();
+    }
+
     /////////////////////////////////////////////////////////////////////
     // Pipeline barrier to ensure staging buffer copy completes before rendering
     /////////////////////////////////////////////////////////////////////
@@ -755,6 +764,19 @@ void VulkanRenderer::startNextFrame()
         0, nullptr
     );
 
+    /////////////////////////////////////////////////////////////////////
+    // Pick the image to display
+    /////////////////////////////////////////////////////////////////////
+
+    // This frame slot's previous submission has completed, so its descriptor set can be rewritten.
+    // Ownership transfers of the accumulation images are recorded here, ahead of the render pass
+    // Back to the placeholder while nothing is published, e.g. after the tracer resized its images
+    VkImageView displayImageView = m_vulkanWindow->getVulkanRayTracer()->acquireDisplayImage(m_frameCount++, commandBuffer);
+    if (displayImageView == VK_NULL_HANDLE && m_displayImageView[currentFrame] != m_renderImage.getImageView())
+        updateDisplayDescriptor(currentFrame, m_renderImage.getImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    else if (displayImageView != VK_NULL_HANDLE && displayImageView != m_displayImageView[currentFrame])
+        updateDisplayDescriptor(currentFrame, displayImageView, VK_IMAGE_LAYOUT_GENERAL);
+
     /////////////////////////////////////////////////////////////////////
     // Begin render pass
     /////////////////////////////////////////////////////////////////////
@@ -790,19 +812,19 @@ void VulkanRenderer::startNextFrame()
     // Map projection matrix
     /////////////////////////////////////////////////////////////////////
     
-    // Camera *camera = m_vulkanWindow->getCamera();
+    // Only the mesh is transformed, the quad is drawn in clip space
+    Camera *camera = m_vulkanWindow->getCamera();
 
-    // QMatrix4x4 projectionMatrix = camera->getProjectionMatrix();
-    // QVector3D cameraPosition = camera->getPosition();
+    QMatrix4x4 projectionMatrix = camera->getProjectionMatrix();
+    QVector3D cameraPosition = camera->getPosition();
 
-    // // VkDeviceSize totalSize = UNIFORM_MATRIX_DATA_SIZE + UNIFORM_VECTOR_DATA_SIZE;
-    // VkDeviceSize offset = m_uniformBufferInfo[currentFrame].offset;
+    VkDeviceSize offset = m_uniformBufferInfo[currentFrame].offset;
 
-    // // Copy projection matrix
-    // m_uniformBuffer.copyData(projectionMatrix.constData(), UNIFORM_MATRIX_DATA_SIZE, offset);
+    // Copy projection matrix
+    m_uniformBuffer.copyData(projectionMatrix.constData(), UNIFORM_MATRIX_DATA_SIZE, offset);
 
-    // // Copy camera position (after matrix)
-    // m_uniformBuffer.copyData(&cameraPosition, UNIFORM_VECTOR_DATA_SIZE, offset + UNIFORM_MATRIX_DATA_SIZE);
+    // Copy camera position (after matrix)
+    m_uniformBuffer.copyData(&cameraPosition, UNIFORM_VECTOR_DATA_SIZE, offset + UNIFORM_MATRIX_DATA_SIZE);
 
 
     /////////////////////////////////////////////////////////////////////
@@ -820,14 +842,6 @@ void VulkanRenderer::startNextFrame()
                                             &m_descriptorSet[currentFrame], 
                                             0, nullptr);
 
-    VkDeviceSize vertexBufferOffset = 0;
-    VkBuffer vertexBuffer = m_vertexBuffer.getBuffer();
-    m_deviceFunctions->vkCmdBindVertexBuffers(commandBuffer, 
-                                            0, 1, 
-                                            &vertexBuffer, 
-                                            &vertexBufferOffset);
-
-
     VkViewport viewport = {
         .x = 0,
         .y = 0,
@@ -848,6 +862,40 @@ void VulkanRenderer::startNextFrame()
     };
     m_deviceFunctions->vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
+    VkDeviceSize vertexBufferOffset = 0;
+
+    // Raster preview first, pixels with few samples let it show through the path-traced image
+    if (m_meshVertexCount > 0) 
+    {
+        DrawPushConstants meshPushConstants = { .meshPass = 1, .fadeSamples = PREVIEW_FADE_SAMPLES };
+        m_deviceFunctions->vkCmdPushConstants(commandBuffer, 
+                                            m_pipelineLayout, 
+                                            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 
+                                            0, sizeof(DrawPushConstants), 
+                                            &meshPushConstants);
+
+        VkBuffer meshVertexBuffer = m_meshVertexBuffer.getBuffer();
+        m_deviceFunctions->vkCmdBindVertexBuffers(commandBuffer, 
+                                                0, 1, 
+                                                &meshVertexBuffer, 
+                                                &vertexBufferOffset);
+
+        m_deviceFunctions->vkCmdDraw(commandBuffer, m_meshVertexCount, 1, 0, 0);
+    }
+
+    DrawPushConstants quadPushConstants = { .meshPass = 0, .fadeSamples = m_meshVertexCount > 0 ? PREVIEW_FADE_SAMPLES : 0.0f };
+    m_deviceFunctions->vkCmdPushConstants(commandBuffer, 
+                                        m_pipelineLayout, 
+                                        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 
+                                        0, sizeof(DrawPushConstants), 
+                                        &quadPushConstants);
+
+    VkBuffer vertexBuffer = m_vertexBuffer.getBuffer();
+    m_deviceFunctions->vkCmdBindVertexBuffers(commandBuffer, 
+                                            0, 1, 
+                                            &vertexBuffer, 
+                                            &vertexBufferOffset);
+
     // Calculate vertex count (each vertex has 8 elements: position, normal, and UV)
     // (x, y, z, x, y, z, u, v)
     const uint32_t vertexCount = sizeof(vertexData) / sizeof(vertexData[0]) / 8;  
@@ -865,112 +913,29 @@ void VulkanRenderer::startNextFrame()
     m_vulkanWindow->requestUpdate(); 
 }
 
-void VulkanRenderer::copyStorageImage(VkFence fence)
+void VulkanRenderer::updateDisplayDescriptor(uint32_t frame, VkImageView imageView, VkImageLayout imageLayout)
 {
-    // Wait for the provided fence to signal (ensuring prior work is complete)
-    if (fence != VK_NULL_HANDLE)
-    {
-        VkResult result = m_deviceFunctions->vkWaitForFences(m_vulkanWindow->device(), 1, &fence, VK_TRUE, UINT64_MAX);
-        if (result != VK_SUCCESS)
-        {
-            qWarning("Failed to wait for input fence (error code: %d)", result);
-            return;
-        }
-    }
-
-    VulkanCommandBuffer commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_computeCommandPool.getCommandPool(), m_computeQueue);
-
-    commandBuffer.beginSingleTimeCommandBuffer();
-
-    VkImage storageImage = m_vulkanWindow->getVulkanRayTracer()->getStorageImage(); 
-
-    VkImageMemoryBarrier imageMemoryBarrierToTransferDst
-    {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .pNext = nullptr,
-        .srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
-        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = m_renderImage.getImage(),
-        .subresourceRange = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        }
-    };  
-
-    m_deviceFunctions->vkCmdPipelineBarrier(
-    commandBuffer.getCommandBuffer(),
-    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-    VK_PIPELINE_STAGE_TRANSFER_BIT,
-    0,
-    0, nullptr,
-    0, nullptr, 
-    1, &imageMemoryBarrierToTransferDst);   
-
-    VkImageCopy imageCopyRegion
+    VkDescriptorImageInfo descriptorImageInfo 
     {
-        .srcSubresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        },
-        .srcOffset = {0, 0, 0},
-        .dstSubresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        },
-        .dstOffset = {0, 0, 0},
-        .extent = {
-            .width = render_width,
-            .height = render_height,
-            .depth = 1
-        }
+        .sampler = m_renderImage.getSampler(),
+        .imageView = imageView,
+        .imageLayout = imageLayout
     };
 
-    m_deviceFunctions->vkCmdCopyImage(
-        commandBuffer.getCommandBuffer(), 
-        storageImage, 
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 
-        m_renderImage.getImage(), 
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-        1, &imageCopyRegion);
-
-    VkImageMemoryBarrier imageMemoryBarrierToShaderRead
+    VkWriteDescriptorSet displayImageWrite
     {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .pNext = nullptr,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = m_renderImage.getImage(),
-        .subresourceRange = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        }
-    };  
-
-    m_deviceFunctions->vkCmdPipelineBarrier(commandBuffer.getCommandBuffer(),
-    VK_PIPELINE_STAGE_TRANSFER_BIT,
-    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-    0,
-    0, nullptr,
-    0, nullptr, 
-    1, &imageMemoryBarrierToShaderRead);   
+        .dstSet = m_descriptorSet[frame],
+        .dstBinding = 1,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &descriptorImageInfo,
+        .pBufferInfo = nullptr,
+        .pTexelBufferView = nullptr
+    };
 
-    commandBuffer.endSubmitAndWait();
+    m_deviceFunctions->vkUpdateDescriptorSets(m_device, 1, &displayImageWrite, 0, nullptr);
+    m_displayImageView[frame] = imageView;
 }
\ No newline at end of file
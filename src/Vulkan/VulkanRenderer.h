@@ -7,6 +7,8 @@
 #include "VulkanBuffer.h"
 #include "VulkanImage.h"
 #include "VulkanCommandPool.h"
+#include "VulkanCommandBuffer.h"
+#include "VulkanPipelineCache.h"
 #include "Camera.h"
 
 
@@ -25,17 +27,20 @@ public:
 
     qint64 getDeltaTimeNs() { return m_renderTimeNs; }
 
-    void copyStorageImage(VkFence fence);
 
 protected:
+    void updateDisplayDescriptor(uint32_t frame, VkImageView imageView, VkImageLayout imageLayout);
+
     VulkanWindow* m_vulkanWindow = nullptr;
 
     VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
     VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
     VkDescriptorSet m_descriptorSet[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
     VkDescriptorBufferInfo m_uniformBufferInfo[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+    VkImageView m_displayImageView[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT]{};
+    uint64_t m_frameCount = 0;
 
-    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    VulkanPipelineCache m_pipelineCache{};
     VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
     VkPipeline m_pipeline = VK_NULL_HANDLE;
 
@@ -53,7 +58,13 @@ protected:
     VulkanBuffer m_vertexBuffer{};
     VulkanBuffer m_vertexStagingBuffer{};
     VulkanBuffer m_uniformBuffer{};
-    VulkanImage m_renderImage{};
+    VulkanImage m_renderImage{};   // Placeholder until the first accumulation image is published
+
+    // Raster preview of the scene under the path-traced image, uploaded once the ray tracer has parsed the OBJ
+    VulkanBuffer m_meshVertexBuffer{};
+    VulkanBuffer m_meshStagingBuffer{};     // Freed once the frame that copied it has completed
+    uint64_t m_meshStagingFrame = 0;
+    uint32_t m_meshVertexCount = 0;
 
     VkDevice m_device = VK_NULL_HANDLE;
     VkResult m_result = VK_NOT_READY;
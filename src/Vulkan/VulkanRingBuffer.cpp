@@ -0,0 +1,58 @@
+#include "VulkanRingBuffer.h"
+#include "VulkanWindow.h"
+
+VulkanRingBuffer::VulkanRingBuffer(VulkanWindow* vulkanWindow, VkDeviceSize regionSize, uint32_t regionCount, VkBufferUsageFlags usage)
+    : m_regionSize(regionSize),
+      m_regionCount(regionCount)
+{
+    m_buffer = VulkanBuffer(vulkanWindow, m_regionSize * m_regionCount, usage, vulkanWindow->hostVisibleMemoryIndex());
+}
+
+void VulkanRingBuffer::swap(VulkanRingBuffer& other) noexcept
+{
+    // VulkanBuffer is move-assignable only
+    VulkanBuffer buffer{};
+    buffer = std::move(m_buffer);
+    m_buffer = std::move(other.m_buffer);
+    other.m_buffer = std::move(buffer);
+
+    std::swap(m_regionSize, other.m_regionSize);
+    std::swap(m_regionCount, other.m_regionCount);
+    std::swap(m_regionStart, other.m_regionStart);
+    std::swap(m_regionOffset, other.m_regionOffset);
+}
+
+VulkanRingBuffer& VulkanRingBuffer::operator=(VulkanRingBuffer&& other) noexcept 
+{
+    if (this != &other) 
+    {
+        destroy();
+        swap(other);
+    }
+    return *this;
+}
+
+void VulkanRingBuffer::beginRegion(uint32_t region)
+{
+    m_regionStart   = (region % m_regionCount) * m_regionSize;
+    m_regionOffset  = 0;
+}
+
+VkDeviceSize VulkanRingBuffer::allocate(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+{
+    VkDeviceSize offset = (m_regionOffset + alignment - 1) / alignment * alignment;
+
+    if (offset + size > m_regionSize)
+    {
+        qWarning("Ring buffer region is full (%llu of %llu bytes requested)", 
+                 static_cast<unsigned long long>(offset + size), static_cast<unsigned long long>(m_regionSize));
+        return VK_WHOLE_SIZE;
+    }
+
+    m_regionOffset = offset + size;
+
+    // Persistently mapped, so this is a memcpy plus a flush on non-coherent memory
+    m_buffer.copyData(data, size, m_regionStart + offset);
+
+    return m_regionStart + offset;
+}
\ No newline at end of file
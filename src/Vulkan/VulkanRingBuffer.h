@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanBuffer.h"
+
+class VulkanWindow;
+
+// Persistently mapped buffer split into one region per frame or submit slot. Transient uniform and staging data is
+// sub-allocated linearly from the current region and bound with dynamic offsets. The caller waits for the slot that
+// last used a region before beginning it again
+class VulkanRingBuffer 
+{
+public:
+    VulkanRingBuffer() = default;
+    VulkanRingBuffer(VulkanWindow* vulkanWindow, VkDeviceSize regionSize, uint32_t regionCount, VkBufferUsageFlags usage);
+
+    VulkanRingBuffer(const VulkanRingBuffer&) = delete;
+    VulkanRingBuffer& operator=(const VulkanRingBuffer&) = delete;
+    VulkanRingBuffer& operator=(VulkanRingBuffer&& other) noexcept;
+
+    VkBuffer getBuffer() const { return m_buffer.getBuffer(); }
+    VkDeviceSize getRegionSize() const { return m_regionSize; }
+
+    void beginRegion(uint32_t region);
+
+    // Copies data into the current region, returns its offset from the start of the buffer or VK_WHOLE_SIZE when the region is full
+    VkDeviceSize allocate(const void* data, VkDeviceSize size, VkDeviceSize alignment);
+
+    void destroy() { m_buffer.destroy(); }
+
+private:
+    void swap(VulkanRingBuffer& other) noexcept;
+
+    VulkanBuffer m_buffer{};
+    VkDeviceSize m_regionSize{};
+    uint32_t m_regionCount{};
+
+    VkDeviceSize m_regionStart{};
+    VkDeviceSize m_regionOffset{};
+};
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "VulkanTimelineSemaphore.h"
+#include "VulkanWindow.h"
+#include <QVulkanFunctions>
+
+VulkanTimelineSemaphore::VulkanTimelineSemaphore(VulkanWindow* vulkanWindow, uint64_t initialValue)
+    : m_vulkanWindow(vulkanWindow)
+{
+    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_vulkanWindow->device());
+
+    createSemaphore(initialValue);
+}
+
+VulkanTimelineSemaphore::~VulkanTimelineSemaphore()
+{
+    cleanup();
+}
+
+void VulkanTimelineSemaphore::swap(VulkanTimelineSemaphore& other) noexcept
+{
+    std::swap(m_vulkanWindow, other.m_vulkanWindow);
+    
+    // Vulkan resources
+    std::swap(m_semaphore, other.m_semaphore);
+    
+    // Device resources
+    std::swap(m_result, other.m_result);
+    std::swap(m_deviceFunctions, other.m_deviceFunctions);
+}
+
+VulkanTimelineSemaphore& VulkanTimelineSemaphore::operator=(VulkanTimelineSemaphore&& other) noexcept 
+{
+    if (this != &other) 
+    {
+        cleanup();
+        swap(other);
+    }
+    return *this;
+}
+
+void VulkanTimelineSemaphore::createSemaphore(uint64_t initialValue)
+{
+    VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo
+    {
+        .sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .pNext         = nullptr,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue  = initialValue
+    };
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo
+    {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &semaphoreTypeCreateInfo,
+        .flags = 0
+    };
+
+    m_result = m_deviceFunctions->vkCreateSemaphore(m_vulkanWindow->device(), &semaphoreCreateInfo, nullptr, &m_semaphore);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to create timeline semaphore (error code: %d)", m_result);
+        return;
+    }
+}
+
+uint64_t VulkanTimelineSemaphore::getCompletedValue()
+{
+    uint64_t value = 0;
+
+    m_result = m_deviceFunctions->vkGetSemaphoreCounterValue(m_vulkanWindow->device(), m_semaphore, &value);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to read timeline semaphore value (error code: %d)", m_result);
+        return 0;
+    }
+
+    return value;
+}
+
+void VulkanTimelineSemaphore::wait(uint64_t value)
+{
+    if (m_semaphore == VK_NULL_HANDLE || value == 0)
+        return;
+
+    VkSemaphoreWaitInfo semaphoreWaitInfo
+    {
+        .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .pNext          = nullptr,
+        .flags          = 0,
+        .semaphoreCount = 1,
+        .pSemaphores    = &m_semaphore,
+        .pValues        = &value
+    };
+
+    m_result = m_deviceFunctions->vkWaitSemaphores(m_vulkanWindow->device(), &semaphoreWaitInfo, UINT64_MAX);
+    if (m_result != VK_SUCCESS)
+    {
+        qWarning("Failed to wait for timeline semaphore (error code: %d)", m_result);
+        return;
+    }
+}
+
+void VulkanTimelineSemaphore::cleanup()
+{
+    if (m_semaphore != VK_NULL_HANDLE)
+    {
+        m_deviceFunctions->vkDestroySemaphore(m_vulkanWindow->device(), m_semaphore, nullptr);
+        m_semaphore = VK_NULL_HANDLE;
+    }
+}
\ No newline at end of file
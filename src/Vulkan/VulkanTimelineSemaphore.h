@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <QVulkanDeviceFunctions>
+
+class VulkanWindow;
+
+// Monotonic GPU counter, needs the timelineSemaphore feature enabled in VulkanWindow
+class VulkanTimelineSemaphore 
+{
+public:
+    VulkanTimelineSemaphore() = default;
+    VulkanTimelineSemaphore(VulkanWindow* vulkanWindow, uint64_t initialValue = 0);
+    ~VulkanTimelineSemaphore();
+
+    VulkanTimelineSemaphore& operator=(VulkanTimelineSemaphore&& other) noexcept;
+
+    VkSemaphore getSemaphore() const { return m_semaphore; }
+    uint64_t getCompletedValue();
+    void wait(uint64_t value);
+
+    void destroy() { cleanup(); }
+
+private:
+    void createSemaphore(uint64_t initialValue);
+    void cleanup();
+    void swap(VulkanTimelineSemaphore& other) noexcept;
+
+    VulkanWindow* m_vulkanWindow = nullptr;
+
+    VkSemaphore m_semaphore = VK_NULL_HANDLE;
+    
+    VkResult m_result = VK_NOT_READY;
+    QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
+};
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "VulkanUploader.h"
+#include "VulkanWindow.h"
+#include <algorithm>
+
+VulkanUploader::VulkanUploader(VulkanWindow* vulkanWindow, uint32_t dstQueueFamilyIndex, VkQueue fallbackQueue, VkDeviceSize stagingSize)
+    : m_vulkanWindow(vulkanWindow),
+      m_dstQueueFamilyIndex(dstQueueFamilyIndex)
+{
+    m_deviceFunctions = m_vulkanWindow->vulkanInstance()->deviceFunctions(m_vulkanWindow->device());
+
+    // Without a transfer-only family the copies go through the destination queue itself
+    m_queueFamilyIndex = m_vulkanWindow->getTransferQueueFamilyIndex();
+    if (m_queueFamilyIndex != UINT32_MAX) 
+    {
+        m_deviceFunctions->vkGetDeviceQueue(m_vulkanWindow->device(), m_queueFamilyIndex, 0, &m_queue);
+    }
+    else 
+    {
+        m_queueFamilyIndex = m_dstQueueFamilyIndex;
+        m_queue = fallbackQueue;
+    }
+
+    m_segmentSize   = stagingSize / SEGMENT_COUNT;
+    m_stagingBuffer = VulkanBuffer(m_vulkanWindow, 
+                                    m_segmentSize * SEGMENT_COUNT,
+                                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                    m_vulkanWindow->hostVisibleMemoryIndex());
+
+    m_commandPool   = VulkanCommandPool(m_vulkanWindow, m_queueFamilyIndex, 
+                                        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+    for (Segment& segment : m_segments) 
+        segment.commandBuffer = VulkanCommandBuffer(m_vulkanWindow, m_commandPool.getCommandPool(), m_queue);
+}
+
+VulkanUploader::~VulkanUploader()
+{
+    // Abandoned loads still have copies reading the ring
+    for (Segment& segment : m_segments) 
+        segment.commandBuffer.wait();
+}
+
+void VulkanUploader::upload(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+    if (std::find(m_dstBuffers.begin(), m_dstBuffers.end(), dstBuffer) == m_dstBuffers.end()) 
+        m_dstBuffers.push_back(dstBuffer);
+
+    const char* bytes = static_cast<const char*>(data);
+
+    // Larger uploads are split into chunks that each fit the space left in the current segment
+    while (size > 0) 
+    {
+        if (m_segments[m_currentSegment].used == m_segmentSize) 
+            submitSegment();
+
+        Segment& segment = m_segments[m_currentSegment];
+
+        VkDeviceSize chunkSize = std::min(size, m_segmentSize - segment.used);
+        VkDeviceSize srcOffset = m_currentSegment * m_segmentSize + segment.used;
+
+        m_stagingBuffer.copyData(bytes, chunkSize, srcOffset);
+        segment.copies[dstBuffer].push_back({ .srcOffset = srcOffset, .dstOffset = dstOffset, .size = chunkSize });
+
+        // Chunks start 16-byte aligned, copies are faster that way on most devices
+        segment.used = std::min(m_segmentSize, (segment.used + chunkSize + 15) / 16 * 16);
+
+        bytes           += chunkSize;
+        dstOffset       += chunkSize;
+        size            -= chunkSize;
+        m_uploadedBytes += chunkSize;
+    }
+}
+
+void VulkanUploader::submitSegment()
+{
+    Segment& segment = m_segments[m_currentSegment];
+
+    if (!segment.copies.empty()) 
+    {
+        segment.commandBuffer.beginCommandBuffer();
+
+        for (const auto& [dstBuffer, regions] : segment.copies) 
+            m_deviceFunctions->vkCmdCopyBuffer(segment.commandBuffer.getCommandBuffer(), 
+                                                m_stagingBuffer.getBuffer(), 
+                                                dstBuffer, 
+                                                uint32_t(regions.size()), regions.data());
+
+        segment.commandBuffer.endAndSubmit();
+        m_submitCount++;
+    }
+
+    // The next segment is reused once the copies recorded into it last time have completed
+    m_currentSegment = (m_currentSegment + 1) % SEGMENT_COUNT;
+
+    Segment& nextSegment = m_segments[m_currentSegment];
+    nextSegment.commandBuffer.wait();
+    nextSegment.used = 0;
+    nextSegment.copies.clear();
+}
+
+std::vector<VkBufferMemoryBarrier> VulkanUploader::ownershipBarriers(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) const
+{
+    std::vector<VkBufferMemoryBarrier> barriers{};
+
+    for (VkBuffer dstBuffer : m_dstBuffers) 
+        barriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = srcAccessMask,
+            .dstAccessMask = dstAccessMask,
+            .srcQueueFamilyIndex = m_queueFamilyIndex,
+            .dstQueueFamilyIndex = m_dstQueueFamilyIndex,
+            .buffer = dstBuffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE
+        });
+
+    return barriers;
+}
+
+void VulkanUploader::finish()
+{
+    submitSegment();
+
+    // Queue submission order puts the release after every copy, so one command buffer covers all of them
+    if (m_queueFamilyIndex != m_dstQueueFamilyIndex && !m_dstBuffers.empty()) 
+    {
+        Segment& segment = m_segments[m_currentSegment];
+        std::vector<VkBufferMemoryBarrier> releaseBarriers = ownershipBarriers(VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+
+        segment.commandBuffer.beginCommandBuffer();
+
+        m_deviceFunctions->vkCmdPipelineBarrier(
+            segment.commandBuffer.getCommandBuffer(),
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            uint32_t(releaseBarriers.size()), releaseBarriers.data(),
+            0, nullptr);
+
+        segment.commandBuffer.endAndSubmit();
+        m_submitCount++;
+    }
+
+    for (Segment& segment : m_segments) 
+        segment.commandBuffer.wait();
+
+    // Nothing reads the ring anymore, its block goes back to the allocator
+    m_stagingBuffer.destroy();
+
+    qDebug("Uploaded %.1f MiB in %u submits through a %.1f MiB staging ring%s", 
+           double(m_uploadedBytes) / (1024.0 * 1024.0), m_submitCount, double(m_segmentSize * SEGMENT_COUNT) / (1024.0 * 1024.0),
+           m_queueFamilyIndex != m_dstQueueFamilyIndex ? " on the transfer queue" : "");
+}
+
+void VulkanUploader::recordAcquireBarriers(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+    if (m_queueFamilyIndex != m_dstQueueFamilyIndex) 
+    {
+        std::vector<VkBufferMemoryBarrier> acquireBarriers = ownershipBarriers(0, dstAccessMask);
+
+        m_deviceFunctions->vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            dstStageMask,
+            0,
+            0, nullptr,
+            uint32_t(acquireBarriers.size()), acquireBarriers.data(),
+            0, nullptr);
+        return;
+    }
+
+    VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = dstAccessMask
+    };
+
+    m_deviceFunctions->vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        dstStageMask,
+        0,
+        1, &memoryBarrier,  // Global memory barrier
+        0, nullptr,
+        0, nullptr);
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <QVulkanDeviceFunctions>
+#include <array>
+#include <map>
+#include <vector>
+
+#include "VulkanBuffer.h"
+#include "VulkanCommandPool.h"
+#include "VulkanCommandBuffer.h"
+
+class VulkanWindow;
+
+// Streams data into device-local buffers through a fixed-size staging ring. The ring is split into segments, each with
+// its own command buffer: a full segment is submitted and the next one is reused once its copies have completed.
+// Uses VulkanWindow's transfer-only queue when the device has one, releasing the buffers to dstQueueFamilyIndex at the end
+class VulkanUploader
+{
+public:
+    VulkanUploader(VulkanWindow* vulkanWindow, uint32_t dstQueueFamilyIndex, VkQueue fallbackQueue, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+    ~VulkanUploader();
+
+    VulkanUploader(const VulkanUploader&) = delete;
+    VulkanUploader& operator=(const VulkanUploader&) = delete;
+
+    // Copies data into the ring right away, the caller's memory can be released as soon as this returns
+    void upload(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+    // Submits what is left, waits for every copy and frees the staging ring
+    void finish();
+
+    // Recorded on the destination queue after finish(), acquires the buffers or just makes the copies visible
+    void recordAcquireBarriers(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+
+    static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 16ull * 1024 * 1024;
+
+private:
+    static constexpr uint32_t SEGMENT_COUNT = 4;
+
+    struct Segment
+    {
+        VulkanCommandBuffer commandBuffer{};
+        VkDeviceSize used = 0;
+        std::map<VkBuffer, std::vector<VkBufferCopy>> copies{}; // One vkCmdCopyBuffer per destination, with all of its regions
+    };
+
+    void submitSegment();
+    std::vector<VkBufferMemoryBarrier> ownershipBarriers(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) const;
+
+    VulkanWindow* m_vulkanWindow = nullptr;
+    uint32_t m_queueFamilyIndex{};
+    uint32_t m_dstQueueFamilyIndex{};
+    VkQueue m_queue = VK_NULL_HANDLE;
+
+    VkDeviceSize m_segmentSize{};
+    VulkanBuffer m_stagingBuffer{};
+    VulkanCommandPool m_commandPool{};
+    std::array<Segment, SEGMENT_COUNT> m_segments{};
+    uint32_t m_currentSegment = 0;
+
+    std::vector<VkBuffer> m_dstBuffers{};
+    VkDeviceSize m_uploadedBytes = 0;
+    uint32_t m_submitCount = 0;
+
+    QVulkanDeviceFunctions* m_deviceFunctions = nullptr;
+};
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <QCursor>
 #include <QWheelEvent>
 #include <QMouseEvent>
+#include <QPlatformSurfaceEvent>
 #include <vulkan/vulkan.h>
 #include <QFile>
 
@@ -90,6 +91,44 @@ VulkanWindow::VulkanWindow()
     // });
     
 
+    // Replaces Qt's default of enabling every supported 1.0 feature, so those are copied through before the ones
+    // the ray tracer depends on are checked. Timeline semaphores track finished trace batches
+    this->setEnabledFeaturesModifier([this](VkPhysicalDeviceFeatures2 &features2) {
+        if (this->physicalDeviceProperties()->apiVersion < VK_API_VERSION_1_2) {
+            qFatal("The device does not support Vulkan 1.2, which timeline semaphores require");
+        }
+
+        VkPhysicalDeviceVulkan12Features supportedVulkan12Features{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .pNext = nullptr
+        };
+        VkPhysicalDeviceFeatures2 supportedFeatures2{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &supportedVulkan12Features
+        };
+        this->vulkanInstance()->functions()->vkGetPhysicalDeviceFeatures2(this->physicalDevice(), &supportedFeatures2);
+
+        if (!supportedVulkan12Features.timelineSemaphore) {
+            qFatal("The device does not support timeline semaphores");
+        }
+        // The compute shader picks its accumulation images with a push constant index
+        if (!supportedFeatures2.features.shaderStorageImageArrayDynamicIndexing) {
+            qFatal("The device does not support dynamic indexing of storage image arrays");
+        }
+
+        // Like Qt's default, robust buffer access stays off as it costs performance
+        features2.features = supportedFeatures2.features;
+        features2.features.robustBufferAccess = VK_FALSE;
+
+        // Filled in again on every call, so the chain never points back at itself
+        m_enabledVulkan12Features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .pNext = features2.pNext,
+            .timelineSemaphore = VK_TRUE
+        };
+        features2.pNext = &m_enabledVulkan12Features;
+    });
+
     // QByteArrayList requiredDeviceExtensions = {
     //     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
     //     VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
@@ -103,23 +142,36 @@ VulkanWindow::VulkanWindow()
 
     // this->setDeviceExtensions(requiredDeviceExtensions);
 
-    this->setQueueCreateInfoModifier([this](const VkQueueFamilyProperties * /*queueFamilies*/,
-                                            uint32_t /*queueFamilyCount*/,
+    // The ray tracer submits from its own thread, so it gets a queue of its own whenever the device has one to spare:
+    // a compute-only family first (async compute), otherwise a second queue in the family Qt renders with.
+    // A family with a single queue leaves the tracer on Qt's queue. Submits from both threads are then serialized
+    // through lockSharedQueue(), which event() holds while Qt renders, presents or recreates the swapchain
+    this->setQueueCreateInfoModifier([this](const VkQueueFamilyProperties *queueFamilies,
+                                            uint32_t queueFamilyCount,
                                             QList<VkDeviceQueueCreateInfo> &queueCreateInfos) {
-        float priority = 1.0f;
+        // Read by the driver when the device is created, after this lambda has returned
+        static const float priorities[] = { 1.0f, 1.0f };
 
-        uint32_t computeQueueFamilyIndex = this->findQueueFamilyIndex(this->physicalDevice(), VK_QUEUE_COMPUTE_BIT);
+        m_computeQueueFamilyIndex = this->findQueueFamilyIndex(this->physicalDevice(), VK_QUEUE_COMPUTE_BIT);
+        m_computeQueueIndex = 0;
+        m_sharesQtQueue = false;
 
-        if (computeQueueFamilyIndex == UINT32_MAX) {
+        if (m_computeQueueFamilyIndex == UINT32_MAX) {
             qFatal("No suitable compute queue found");
         }
 
         // Check if we already requested this family
         bool alreadyRequested = false;
         for (auto &queueCreateInfo : queueCreateInfos) {
-            if (queueCreateInfo.queueFamilyIndex == computeQueueFamilyIndex) {
+            if (queueCreateInfo.queueFamilyIndex == m_computeQueueFamilyIndex) {
                 alreadyRequested = true;
-                queueCreateInfo.queueCount = std::max(queueCreateInfo.queueCount, 1u);
+
+                if (queueFamilies[m_computeQueueFamilyIndex].queueCount > 1) {
+                    queueCreateInfo.queueCount = 2;
+                    queueCreateInfo.pQueuePriorities = priorities;
+                    m_computeQueueIndex = 1;
+                }
+                m_sharesQtQueue = m_computeQueueIndex == 0;
                 break;
             }
         }
@@ -127,17 +179,52 @@ VulkanWindow::VulkanWindow()
         if (!alreadyRequested) {
             VkDeviceQueueCreateInfo computeQueueInfo{};
             computeQueueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            computeQueueInfo.queueFamilyIndex = computeQueueFamilyIndex;
+            computeQueueInfo.queueFamilyIndex = m_computeQueueFamilyIndex;
             computeQueueInfo.queueCount = 1;
-            computeQueueInfo.pQueuePriorities = &priority;
+            computeQueueInfo.pQueuePriorities = priorities;
 
             queueCreateInfos.append(computeQueueInfo);
         }
+
+        qDebug("Ray tracing on queue family %u, queue %u%s", m_computeQueueFamilyIndex, m_computeQueueIndex,
+               alreadyRequested ? (m_sharesQtQueue ? " (shared with Qt)" : "") : " (async compute)");
+
+        // Uploads go through the copy engine when the device exposes a transfer-only family
+        m_transferQueueFamilyIndex = UINT32_MAX;
+        for (uint32_t queueFamilyIndex = 0; queueFamilyIndex < queueFamilyCount; queueFamilyIndex++) {
+            VkQueueFlags queueFlags = queueFamilies[queueFamilyIndex].queueFlags;
+            if ((queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                m_transferQueueFamilyIndex = queueFamilyIndex;
+                break;
+            }
+        }
+
+        if (m_transferQueueFamilyIndex != UINT32_MAX) {
+            VkDeviceQueueCreateInfo transferQueueInfo{};
+            transferQueueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            transferQueueInfo.queueFamilyIndex = m_transferQueueFamilyIndex;
+            transferQueueInfo.queueCount = 1;
+            transferQueueInfo.pQueuePriorities = priorities;
+
+            queueCreateInfos.append(transferQueueInfo);
+
+            qDebug("Uploading on transfer queue family %u", m_transferQueueFamilyIndex);
+        }
     });
     
     QWindow::setCursor(Qt::OpenHandCursor);
 
     m_camera = new Camera(this);
+
+#ifdef SHADER_HOT_RELOAD
+    // Only the ray tracing shader is swapped at runtime, the raster shaders take effect on the next launch
+    m_shaderHotReloader = std::make_unique<ShaderHotReloader>(QStringLiteral(SHADER_SOURCE_DIR), QStringLiteral(GLSLANG_VALIDATOR_EXECUTABLE),
+        QStringLiteral(GLSLANG_TARGET_ENV),
+        [this](const QString& shaderName, const QString& spirvPath) {
+            if ((shaderName == QStringLiteral("raytrace_comp") || shaderName == QStringLiteral("raytrace_stats_comp")) && m_vulkanRayTracer) 
+                m_vulkanRayTracer->reloadComputeShader(shaderName, spirvPath);
+        });
+#endif
     
 }
 
@@ -146,6 +233,10 @@ QVulkanWindowRenderer *VulkanWindow::createRenderer()
     m_vulkanRenderer = new VulkanRenderer(this);
     m_vulkanRayTracer = new VulkanRayTracer(this);
 
+    // Lets a different environment be lit without rebuilding, e.g. PATH_TRACER_ENVIRONMENT=/path/to/sky.hdr
+    if (qEnvironmentVariableIsSet("PATH_TRACER_ENVIRONMENT"))
+        m_vulkanRayTracer->setEnvironmentPath(qEnvironmentVariable("PATH_TRACER_ENVIRONMENT").toStdString());
+
     return m_vulkanRenderer;
 }
 
@@ -230,6 +321,35 @@ void VulkanWindow::wheelEvent(QWheelEvent *event)
     m_camera->cameraZoomUpdate(m_zoom);
 }
 
+std::unique_lock<std::recursive_mutex> VulkanWindow::lockSharedQueue()
+{
+    if (!m_sharesQtQueue) 
+        return {};
+    return std::unique_lock<std::recursive_mutex>(m_sharedQueueMutex);
+}
+
+bool VulkanWindow::event(QEvent *event)
+{
+    // Releasing the resources joins the ray tracer, which may be waiting for the lock to submit. Stopped first
+    if (event->type() == QEvent::PlatformSurface && m_vulkanRayTracer &&
+        static_cast<QPlatformSurfaceEvent*>(event)->surfaceEventType() == QPlatformSurfaceEvent::SurfaceAboutToBeDestroyed) {
+        m_vulkanRayTracer->stop();
+    }
+
+    // QVulkanWindow submits, presents and waits for the device idle only while handling these. Held for the whole
+    // frame, as the renderer calls frameReady() from startNextFrame()
+    switch (event->type()) {
+    case QEvent::UpdateRequest:
+    case QEvent::Expose:
+    case QEvent::PlatformSurface: {
+        auto sharedQueueLock = lockSharedQueue();
+        return QVulkanWindow::event(event);
+    }
+    default:
+        return QVulkanWindow::event(event);
+    }
+}
+
 void VulkanWindow::mousePressEvent(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) 
@@ -5,6 +5,11 @@
 #include "VulkanRayTracer.h"
 #include "VulkanRenderer.h"
 #include "Camera.h"
+#include "VulkanMemoryAllocator.h"
+#include "ShaderHotReloader.h"
+
+#include <memory>
+#include <mutex>
 
 class VulkanWindow : public QVulkanWindow
 {
@@ -14,13 +19,24 @@ public:
     QVulkanWindowRenderer* createRenderer() override;
 
     uint32_t findQueueFamilyIndex(VkPhysicalDevice physicalDevice, VkQueueFlagBits bit);
+
+    // Picked when the device is created, index 0 of the graphics family when no other queue was available
+    uint32_t getComputeQueueFamilyIndex() const { return m_computeQueueFamilyIndex; }
+    uint32_t getComputeQueueIndex() const { return m_computeQueueIndex; }
+    // Queue 0 of a transfer-only family, UINT32_MAX when the device has none
+    uint32_t getTransferQueueFamilyIndex() const { return m_transferQueueFamilyIndex; }
+    // Held around every use of the ray tracer's queue when it is the one Qt submits and presents on, see the queue
+    // modifier. Owns nothing when the tracer has a queue of its own
+    std::unique_lock<std::recursive_mutex> lockSharedQueue();
     VkShaderModule createShaderModule(const QString& filename);
 
     Camera* getCamera() { return m_camera; }
     VulkanRayTracer* getVulkanRayTracer() { return m_vulkanRayTracer; }
     VulkanRenderer* getVulkanRenderer() { return m_vulkanRenderer; }
+    VulkanMemoryAllocator& getMemoryAllocator() { return m_memoryAllocator; }
 
 protected:
+    bool event(QEvent* event) override;
     void mousePressEvent(QMouseEvent* event) override;
     void mouseMoveEvent(QMouseEvent* event) override;
     void mouseReleaseEvent(QMouseEvent* event) override;
@@ -31,7 +47,22 @@ private:
     float m_zoom{};
     QPoint m_lastCursorPosition{};
 
+    uint32_t m_computeQueueFamilyIndex = UINT32_MAX;
+    uint32_t m_computeQueueIndex = 0;
+    uint32_t m_transferQueueFamilyIndex = UINT32_MAX;
+    bool m_sharesQtQueue = false;
+    std::recursive_mutex m_sharedQueueMutex{}; // Recursive, Qt's frame may submit through VulkanCommandBuffer as well
+
+    // Shared by the renderer and the ray tracer thread, VulkanBuffer and VulkanImage allocate through it
+    VulkanMemoryAllocator m_memoryAllocator{this};
+
+    // Only created in SHADER_HOT_RELOAD builds
+    std::unique_ptr<ShaderHotReloader> m_shaderHotReloader{};
+
     Camera* m_camera = nullptr;
     VulkanRayTracer* m_vulkanRayTracer = nullptr;
     VulkanRenderer* m_vulkanRenderer = nullptr;
+
+    // Chained into the device create info by the features modifier, read when the device is created
+    VkPhysicalDeviceVulkan12Features m_enabledVulkan12Features{};
 };
\ No newline at end of file
@@ -9,7 +9,20 @@ layout(location = 0) out vec4 fragColor;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+layout(push_constant) uniform PushConsts {
+    uint meshPass;      // 1 for the scene's triangles, 0 for the full-screen quad showing the path-traced image
+    float fadeSamples;  // Samples per pixel at which the path-traced image fully covers the mesh, 0 when no mesh is drawn
+} pushConstants;
+
 void main() {
+    // Headlight shading, two-sided because the faces of the scene are not consistently wound
+    if (pushConstants.meshPass != 0) {
+        vec3 N = normalize(v_normal);
+        vec3 L = normalize(v_cameraPos - v_vertPos);
+        fragColor = vec4(vec3(0.1 + 0.7 * abs(dot(N, L))), 1.0);
+        return;
+    }
+
     vec4 textureColor = texture(texSampler, v_uv);
     vec4 specularColor = vec4(1.0, 1.0, 1.0, 1.0);
     vec4 ambientColor = vec4(1.0, 1.0, 1.0, 1.0) * textureColor;
@@ -37,5 +50,7 @@ void main() {
     // fragColor = Ka * ambientColor + 
     //             Kd * lambertian * textureColor + 
     //             Ks * specular * specularColor;
-    fragColor = ambientColor;
+    // Alpha of the accumulation image is its sample count, the mesh underneath fades out as it grows
+    float traceWeight = pushConstants.fadeSamples > 0.0 ? clamp(textureColor.a / pushConstants.fadeSamples, 0.0, 1.0) : 1.0;
+    fragColor = vec4(ambientColor.rgb, traceWeight);
 }
@@ -14,6 +14,11 @@ layout(std140, binding = 0) uniform buf {
     vec3 cameraPos;
 } ubuf;
 
+layout(push_constant) uniform PushConsts {
+    uint meshPass;      // 1 for the scene's triangles, 0 for the full-screen quad showing the path-traced image
+    float fadeSamples;
+} pushConstants;
+
 out gl_PerVertex { vec4 gl_Position; };
 
 void main()
@@ -26,5 +31,6 @@ void main()
 
     v_cameraPos = ubuf.cameraPos;
     
-    gl_Position = ubuf.mvp * vec4(position, 1.0);
+    // The quad is already in clip space, at depth 0 so it is never hidden by the mesh
+    gl_Position = pushConstants.meshPass != 0 ? ubuf.mvp * vec4(position, 1.0) : vec4(position, 1.0);
 }